@@ -0,0 +1,587 @@
+/*
+ * advsearch.c - search for traces that make mm.c behave as badly as
+ *     possible
+ *
+ * Usage: advsearch [-v] [-c <cost>] [-f <trace>] [-s <seed>] [-n <ops>]
+ *                  [-N <ops>] [-i <iters>] [-r <climbs>] [-z <size>]
+ *                  [-m <size>] -o <prefix>
+ *
+ * Each climb starts from a random sequence of requests (or the trace
+ * given with -f) and hill-climbs: it makes a few random changes to the
+ * best sequence so far, replays the result on mm.c, and keeps it if it
+ * costs at least as much. The costs are
+ *
+ *   util     heap size at the end over the peak of live payload bytes
+ *            (fragmentation and overhead)
+ *   steps    free blocks find_first looks at per request, as counted
+ *            by mm_stats (long searches)
+ *   latency  the slowest single request, in timer ticks
+ *   time     the average request, in timer ticks
+ *
+ * Timed costs are the least of TIMED_RUNS replays, so that one slow
+ * request has to be slow every time, not just interrupted once.
+ *
+ * A sequence is stored so that any change to it is still a valid
+ * trace: a free or realloc names its block by its position among the
+ * blocks live at that point rather than by id, taken modulo how many
+ * there are (with none, it becomes a malloc). Blocks still live at the
+ * end are freed. The worst trace of climb k is written to
+ * <prefix>-<k>.rep, for use as a regression trace.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "trace.h"
+#include "latency.h"
+
+#define MAXLINE     1024   /* max string size */
+#define MAX_CHANGES 4      /* most changes made to a sequence at once */
+#define TIMED_RUNS  3      /* replays a timed cost is the least of */
+
+int verbose = 0; /* read by trace.c */
+
+/* Costs to maximise */
+enum {COST_UTIL, COST_STEPS, COST_LATENCY, COST_TIME};
+static char *cost_names[] = {"util", "steps", "latency", "time", NULL};
+
+/* One request of a sequence */
+typedef struct {
+    int type;               /* ALLOC, FREE or REALLOC */
+    int size;               /* payload size of an ALLOC or REALLOC */
+    unsigned pick;          /* which live block a FREE or REALLOC is on */
+} gene_t;
+
+/* A sequence of requests and what it cost */
+typedef struct {
+    gene_t *g;
+    int n;
+    double cost;            /* negative if mm.c failed on it */
+} seq_t;
+
+/* Search parameters */
+static int cost = COST_UTIL;
+static int init_ops = 1000;   /* requests in a random starting sequence */
+static int max_ops = 4000;    /* most requests in a sequence */
+static int max_size = 4096;   /* largest payload size */
+
+/* The trace the sequence being evaluated decodes to */
+static trace_t trace;
+static int *live_ids = NULL;  /* ids live at the current request */
+
+/* The random number generator state (xorshift64*) */
+static unsigned long long rng;
+
+/* function prototypes */
+static void random_seq(seq_t *s);
+static void load_seq(seq_t *s, char *path);
+static void copy_seq(seq_t *dst, seq_t *src);
+static void mutate(seq_t *s);
+static void random_gene(gene_t *g);
+static int random_size(int old);
+static void decode(seq_t *s);
+static double evaluate(seq_t *s);
+static double replay(void);
+static void save_seq(seq_t *s, char *path);
+static double uniform(void);
+static int pick(int n);
+static size_t parse_size(char *str);
+static void usage(void);
+
+int main(int argc, char **argv)
+{
+    seq_t best, child, tmp;
+    char *prefix = NULL, *start = NULL, path[MAXLINE];
+    unsigned long long seed = 1;
+    size_t max_heap = 0;
+    long iters = 2000, it;
+    int climbs = 4, c, k;
+
+    while ((c = getopt(argc, argv, "c:f:s:n:N:i:r:z:m:o:vh")) != EOF) {
+	switch (c) {
+	case 'c':
+	    for (cost = 0; cost_names[cost] != NULL; cost++)
+		if (!strcmp(optarg, cost_names[cost]))
+		    break;
+	    if (cost_names[cost] == NULL) {
+		usage();
+		exit(1);
+	    }
+	    break;
+	case 'f':
+	    start = optarg;
+	    break;
+	case 's':
+	    seed = strtoull(optarg, NULL, 0);
+	    break;
+	case 'n':
+	    init_ops = atoi(optarg);
+	    break;
+	case 'N':
+	    max_ops = atoi(optarg);
+	    break;
+	case 'i':
+	    iters = atol(optarg);
+	    break;
+	case 'r':
+	    climbs = atoi(optarg);
+	    break;
+	case 'z':
+	    max_size = atoi(optarg);
+	    break;
+	case 'm':
+	    if ((max_heap = parse_size(optarg)) == 0) {
+		usage();
+		exit(1);
+	    }
+	    break;
+	case 'o':
+	    prefix = optarg;
+	    break;
+	case 'v':
+	    verbose = 1;
+	    break;
+	default:
+	    usage();
+	    exit(c != 'h');
+	}
+    }
+    if (prefix == NULL || optind != argc || init_ops < 1 ||
+	max_ops < init_ops || iters < 0 || climbs < 1 || max_size < 1) {
+	usage();
+	exit(1);
+    }
+
+    /* Seed the generator; splitmix64 spreads small seeds out */
+    seed += 0x9e3779b97f4a7c15ULL;
+    seed = (seed ^ (seed >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    seed = (seed ^ (seed >> 27)) * 0x94d049bb133111ebULL;
+    rng = (seed ^ (seed >> 31)) | 1;
+
+    if (max_heap)
+	mem_set_max_heap(max_heap);
+    mem_init();
+    memset(&best, 0, sizeof(best));
+    memset(&child, 0, sizeof(child));
+
+    for (k = 1; k <= climbs; k++) {
+	if (start != NULL)
+	    load_seq(&best, start);
+	else
+	    random_seq(&best);
+	best.cost = evaluate(&best);
+	if (verbose)
+	    printf("climb %d: start at %s cost %.3f\n", k, cost_names[cost],
+		   best.cost);
+
+	for (it = 1; it <= iters; it++) {
+	    copy_seq(&child, &best);
+	    mutate(&child);
+	    child.cost = evaluate(&child);
+	    if (child.cost < 0 || child.cost < best.cost)
+		continue;
+	    if (verbose && child.cost > best.cost)
+		printf("climb %d, iteration %ld: cost %.3f, %d requests\n",
+		       k, it, child.cost, child.n);
+	    tmp = best;  /* swap, so that the old best's array gets reused */
+	    best = child;
+	    child = tmp;
+	}
+
+	sprintf(path, "%s-%d.rep", prefix, k);
+	save_seq(&best, path);
+	printf("climb %d: %s cost %.3f, %d requests, written to %s\n", k,
+	       cost_names[cost], best.cost, trace.num_ops, path);
+    }
+    exit(0);
+}
+
+/*
+ * random_seq - fill s with init_ops random requests
+ */
+static void random_seq(seq_t *s)
+{
+    int i;
+
+    s->g = (gene_t *)realloc(s->g, max_ops * sizeof(gene_t));
+    if (s->g == NULL) {
+	fprintf(stderr, "advsearch: out of memory\n");
+	exit(1);
+    }
+    s->n = init_ops;
+    for (i = 0; i < s->n; i++)
+	random_gene(&s->g[i]);
+}
+
+/*
+ * load_seq - turn the trace at path into a sequence, naming the block
+ *     of each free and realloc by its position among the live blocks as
+ *     decode will have them. A free is given the size of the block, in
+ *     case a change makes it a malloc or realloc.
+ */
+static void load_seq(seq_t *s, char *path)
+{
+    trace_t *t;
+    int *pos, *ids, *sizes, nlive = 0, i, id;
+
+    t = read_trace("", path);
+    if (t->num_ops > max_ops)
+	max_ops = t->num_ops;
+    s->g = (gene_t *)realloc(s->g, max_ops * sizeof(gene_t));
+    pos = (int *)malloc((t->num_ids + 1) * sizeof(int));
+    ids = (int *)malloc((t->num_ids + 1) * sizeof(int));
+    sizes = (int *)malloc((t->num_ids + 1) * sizeof(int));
+    if (s->g == NULL || pos == NULL || ids == NULL || sizes == NULL) {
+	fprintf(stderr, "advsearch: out of memory\n");
+	exit(1);
+    }
+    s->n = t->num_ops;
+    for (i = 0; i < t->num_ops; i++) {
+	id = t->ops[i].index;
+	s->g[i].type = t->ops[i].type;
+	s->g[i].size = t->ops[i].size;
+	s->g[i].pick = 0;
+	switch (t->ops[i].type) {
+	case ALLOC:
+	    pos[id] = nlive;
+	    ids[nlive++] = id;
+	    sizes[id] = t->ops[i].size;
+	    break;
+	case REALLOC:
+	    s->g[i].pick = pos[id];
+	    sizes[id] = t->ops[i].size;
+	    break;
+	default: /* FREE; decode moves the last live block into the hole */
+	    s->g[i].size = sizes[id];
+	    s->g[i].pick = pos[id];
+	    ids[pos[id]] = ids[--nlive];
+	    pos[ids[nlive]] = pos[id];
+	    break;
+	}
+    }
+    free(pos);
+    free(ids);
+    free(sizes);
+    free_trace(t);
+}
+
+/*
+ * copy_seq - make dst a copy of src
+ */
+static void copy_seq(seq_t *dst, seq_t *src)
+{
+    if (dst->g == NULL &&
+	(dst->g = (gene_t *)malloc(max_ops * sizeof(gene_t))) == NULL) {
+	fprintf(stderr, "advsearch: out of memory\n");
+	exit(1);
+    }
+    memcpy(dst->g, src->g, src->n * sizeof(gene_t));
+    dst->n = src->n;
+    dst->cost = src->cost;
+}
+
+/*
+ * mutate - make between 1 and MAX_CHANGES random changes to s: resize,
+ *     retarget or change the type of a request, insert or delete one,
+ *     swap two, or repeat a run of requests (which is what tends to
+ *     build up fragmentation)
+ */
+static void mutate(seq_t *s)
+{
+    int changes = 1 + pick(MAX_CHANGES), i, j, len;
+    gene_t g;
+
+    while (changes-- > 0) {
+	i = pick(s->n);
+	switch (pick(7)) {
+	case 0:
+	    s->g[i].size = random_size(s->g[i].size);
+	    break;
+	case 1:
+	    s->g[i].pick = (unsigned)(uniform() * 4294967296.0);
+	    break;
+	case 2:
+	    s->g[i].type = pick(3) == 0 ? REALLOC : pick(2) ? ALLOC : FREE;
+	    break;
+	case 3:
+	    if (s->n == max_ops)
+		break;
+	    memmove(&s->g[i+1], &s->g[i], (s->n - i) * sizeof(gene_t));
+	    random_gene(&s->g[i]);
+	    s->n++;
+	    break;
+	case 4:
+	    if (s->n == 1)
+		break;
+	    memmove(&s->g[i], &s->g[i+1], (s->n - i - 1) * sizeof(gene_t));
+	    s->n--;
+	    break;
+	case 5:
+	    j = pick(s->n);
+	    g = s->g[i];
+	    s->g[i] = s->g[j];
+	    s->g[j] = g;
+	    break;
+	case 6:
+	    len = 1 + pick(s->n - i < 64 ? s->n - i : 64);
+	    if (s->n + len > max_ops)
+		break;
+	    memmove(&s->g[i+len], &s->g[i], (s->n - i) * sizeof(gene_t));
+	    s->n += len;
+	    break;
+	}
+    }
+}
+
+/*
+ * random_gene - make g a random request
+ */
+static void random_gene(gene_t *g)
+{
+    double u = uniform();
+
+    g->type = (u < 0.5) ? ALLOC : (u < 0.85) ? FREE : REALLOC;
+    g->size = random_size(0);
+    g->pick = (unsigned)(uniform() * 4294967296.0);
+}
+
+/*
+ * random_size - returns a new size: near old, if there is one, half the
+ *     time, and otherwise log-uniform or just around a power of two (a
+ *     likely size class boundary)
+ */
+static int random_size(int old)
+{
+    double u = uniform();
+    int size;
+
+    if (old > 0 && u < 0.5)
+	size = (u < 0.25) ? old + pick(33) - 16 :
+	    (u < 0.375) ? old * 2 : old / 2;
+    else if (u < 0.75)
+	size = (int)exp(uniform() * log((double)max_size + 1));
+    else
+	size = (1 << pick((int)log2((double)max_size) + 1)) + pick(17) - 8;
+    return size < 1 ? 1 : size > max_size ? max_size : size;
+}
+
+/*
+ * decode - turn s into the trace it stands for
+ */
+static void decode(seq_t *s)
+{
+    traceop_t *op;
+    int i, j, nlive = 0, type;
+
+    if (trace.ops == NULL) {
+	trace.weight = 1;
+	trace.ops = (traceop_t *)malloc(2 * max_ops * sizeof(traceop_t));
+	trace.blocks = (char **)malloc(max_ops * sizeof(char *));
+	trace.block_sizes = (size_t *)malloc(max_ops * sizeof(size_t));
+	live_ids = (int *)malloc(max_ops * sizeof(int));
+	if (trace.ops == NULL || trace.blocks == NULL ||
+	    trace.block_sizes == NULL || live_ids == NULL) {
+	    fprintf(stderr, "advsearch: out of memory\n");
+	    exit(1);
+	}
+    }
+
+    trace.num_ids = trace.num_ops = 0;
+    for (i = 0; i < s->n; i++) {
+	op = &trace.ops[trace.num_ops++];
+	type = (nlive == 0) ? ALLOC : s->g[i].type;
+	op->type = type;
+	op->size = s->g[i].size;
+	if (type == ALLOC) {
+	    op->index = trace.num_ids;
+	    live_ids[nlive++] = trace.num_ids++;
+	    continue;
+	}
+	j = s->g[i].pick % nlive;
+	op->index = live_ids[j];
+	if (type == FREE)
+	    live_ids[j] = live_ids[--nlive];
+    }
+    while (nlive > 0) {
+	op = &trace.ops[trace.num_ops++];
+	op->type = FREE;
+	op->index = live_ids[--nlive];
+	op->size = 0;
+    }
+}
+
+/*
+ * evaluate - returns what s costs, or -1 if mm.c failed on it
+ */
+static double evaluate(seq_t *s)
+{
+    double c, least = -1;
+    int runs = (cost == COST_UTIL || cost == COST_STEPS) ? 1 : TIMED_RUNS;
+
+    decode(s);
+    while (runs-- > 0) {
+	if ((c = replay()) < 0)
+	    return -1;
+	if (least < 0 || c < least)
+	    least = c;
+    }
+    return least;
+}
+
+/*
+ * replay - run the decoded trace on mm.c and returns its cost, or -1 if
+ *     a request failed
+ */
+static double replay(void)
+{
+    traceop_t *op;
+    mm_stats_t st;
+    unsigned long long t0, t1, slowest = 0, total = 0;
+    long long live = 0, peak = 0;
+    char *p;
+    int i;
+
+    mem_reset_brk();
+    if (mm_init() < 0)
+	return -1;
+    for (i = 0; i < trace.num_ops; i++) {
+	op = &trace.ops[i];
+	t0 = lat_ticks();
+	switch (op->type) {
+	case ALLOC:
+	    p = mm_malloc(op->size);
+	    break;
+	case REALLOC:
+	    p = mm_realloc(trace.blocks[op->index], op->size);
+	    break;
+	default: /* FREE */
+	    mm_free(trace.blocks[op->index]);
+	    p = NULL;
+	    break;
+	}
+	t1 = lat_ticks() - t0;
+	total += t1;
+	if (t1 > slowest)
+	    slowest = t1;
+
+	if (op->type == FREE) {
+	    live -= trace.block_sizes[op->index];
+	    continue;
+	}
+	if (p == NULL)
+	    return -1;
+	if (op->type == REALLOC)
+	    live -= trace.block_sizes[op->index];
+	trace.blocks[op->index] = p;
+	trace.block_sizes[op->index] = op->size;
+	live += op->size;
+	if (live > peak)
+	    peak = live;
+    }
+
+    switch (cost) {
+    case COST_UTIL:
+	return peak ? (double)mem_heapsize() / peak : 0;
+    case COST_STEPS:
+	if (mm_stats(&st) < 0) {
+	    fprintf(stderr, "advsearch: mm.c was built without MM_STATS\n");
+	    exit(1);
+	}
+	return (double)st.search_steps / trace.num_ops;
+    case COST_LATENCY:
+	return (double)slowest;
+    default:
+	return (double)total / trace.num_ops;
+    }
+}
+
+/*
+ * save_seq - write the trace s stands for to path
+ */
+static void save_seq(seq_t *s, char *path)
+{
+    decode(s);
+    trace.sugg_heapsize = 0;
+    if (write_trace(&trace, path) < 0) {
+	fprintf(stderr, "advsearch: could not write %s: %s\n", path,
+		strerror(errno));
+	exit(1);
+    }
+}
+
+/*
+ * uniform - returns a random number in [0, 1), like tracegen's
+ */
+static double uniform(void)
+{
+    rng ^= rng >> 12;
+    rng ^= rng << 25;
+    rng ^= rng >> 27;
+    return ((rng * 0x2545f4914f6cdd1dULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* pick - returns a random integer in [0, n) */
+static int pick(int n)
+{
+    return (int)(uniform() * n);
+}
+
+/*
+ * parse_size - parse a byte count with an optional K, M or G suffix,
+ *     returning 0 if it is malformed
+ */
+static size_t parse_size(char *str)
+{
+    char *end;
+    unsigned long long val = strtoull(str, &end, 10);
+
+    switch (*end) {
+    case 'g': case 'G':
+	val <<= 10;
+	/* fall through */
+    case 'm': case 'M':
+	val <<= 10;
+	/* fall through */
+    case 'k': case 'K':
+	val <<= 10;
+	end++;
+	break;
+    }
+    if (*end != '\0' || val != (size_t)val)
+	return 0;
+    return (size_t)val;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: advsearch [-v] [-c util|steps|latency|time] "
+	    "[-f <trace>] [-s <seed>]\n");
+    fprintf(stderr, "                 [-n <ops>] [-N <ops>] [-i <iters>] "
+	    "[-r <climbs>] [-z <size>]\n");
+    fprintf(stderr, "                 [-m <size>] -o <prefix>\n");
+    fprintf(stderr, "\t-c <cost>    What to maximise: heap over peak live "
+	    "bytes (util),\n");
+    fprintf(stderr, "\t             free list steps per request (steps), "
+	    "slowest\n");
+    fprintf(stderr, "\t             request (latency) or average request "
+	    "(time).\n");
+    fprintf(stderr, "\t-f <trace>   Start every climb from this trace.\n");
+    fprintf(stderr, "\t-s <seed>    Seed the random numbers (default 1).\n");
+    fprintf(stderr, "\t-n <ops>     Requests in a random start (default "
+	    "1000).\n");
+    fprintf(stderr, "\t-N <ops>     Most requests in a trace (default "
+	    "4000).\n");
+    fprintf(stderr, "\t-i <iters>   Changes tried per climb (default "
+	    "2000).\n");
+    fprintf(stderr, "\t-r <climbs>  Independent climbs (default 4).\n");
+    fprintf(stderr, "\t-z <size>    Largest payload (default 4096).\n");
+    fprintf(stderr, "\t-m <size>    Heap reservation (K/M/G suffix).\n");
+    fprintf(stderr, "\t-o <prefix>  Write climb k's worst trace to "
+	    "<prefix>-<k>.rep.\n");
+    fprintf(stderr, "\t-v           Report every improvement.\n");
+}
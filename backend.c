@@ -0,0 +1,104 @@
+/*
+ * backend.c - the registry of malloc packages linked into mdriver, and
+ *     a loader for packages built as plugins
+ *
+ * The Makefile passes EXTRA_BACKENDS as a list of BACKEND(name) for the
+ * allocators other than mm.c, each one built from mm-<name>.c with its
+ * symbols renamed.
+ *
+ * mm_stats and mm_walk are optional, so the extra backends only refer to
+ * them weakly.
+ *
+ * A plugin is a shared object that exports the mm.h functions (and, if
+ * it likes, team, mm_stats and mm_walk) under their usual names. It gets
+ * memlib's functions from the driver, which is linked with -rdynamic for
+ * the purpose, and must be linked with -Bsymbolic so that its calls to
+ * its own mm_* functions don't end up in mm.c's (see "make plugins").
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dlfcn.h>
+
+#include "backend.h"
+
+#ifndef EXTRA_BACKENDS
+#define EXTRA_BACKENDS
+#endif
+
+/* Declare the renamed interface of each extra backend... */
+#define BACKEND(name) \
+    extern team_t name##_team; \
+    extern int name##_mm_init(void); \
+    extern void *name##_mm_malloc(size_t size); \
+    extern void name##_mm_free(void *ptr); \
+    extern void *name##_mm_realloc(void *ptr, size_t size); \
+    extern int name##_mm_stats(mm_stats_t *stats) __attribute__((weak)); \
+    extern int name##_mm_walk(mm_walk_fn fn, void *arg) __attribute__((weak));
+EXTRA_BACKENDS
+#undef BACKEND
+
+/* ... and list it after mm.c */
+#define BACKEND(name) \
+    {#name, &name##_team, name##_mm_init, name##_mm_malloc, \
+     name##_mm_free, name##_mm_realloc, name##_mm_stats, name##_mm_walk},
+
+backend_t backends[] = {
+    {"mm", &team, mm_init, mm_malloc, mm_free, mm_realloc, mm_stats,
+     mm_walk},
+    EXTRA_BACKENDS
+    {NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL}
+};
+
+/*
+ * find_backend - returns the backend called name, or NULL
+ */
+backend_t *find_backend(char *name)
+{
+    backend_t *b;
+
+    for (b = backends; b->name != NULL; b++)
+	if (!strcmp(b->name, name))
+	    return b;
+    return NULL;
+}
+
+/*
+ * load_backend - load the malloc package in the shared object at path.
+ *     It is named after the file, less any directory, so that a plugin
+ *     built from mm.c (mm.so) can be told apart from mm itself. Exits
+ *     if the object can't be loaded or lacks one of the functions.
+ */
+backend_t *load_backend(char *path)
+{
+    static char *funcs[] = {"mm_init", "mm_malloc", "mm_free", "mm_realloc"};
+    void *handle, *sym[4];
+    backend_t *b;
+    char *base;
+    int i;
+
+    if ((handle = dlopen(path, RTLD_NOW | RTLD_LOCAL)) == NULL) {
+	printf("Could not load malloc package %s: %s\n", path, dlerror());
+	exit(1);
+    }
+    for (i = 0; i < 4; i++) {
+	if ((sym[i] = dlsym(handle, funcs[i])) == NULL) {
+	    printf("Malloc package %s has no %s\n", path, funcs[i]);
+	    exit(1);
+	}
+    }
+
+    if ((b = (backend_t *)calloc(1, sizeof(backend_t))) == NULL) {
+	printf("Could not load malloc package %s: out of memory\n", path);
+	exit(1);
+    }
+    b->name = ((base = strrchr(path, '/')) != NULL) ? base + 1 : path;
+    b->team = (team_t *)dlsym(handle, "team");
+    b->init = (int (*)(void))sym[0];
+    b->malloc = (void *(*)(size_t))sym[1];
+    b->free = (void (*)(void *))sym[2];
+    b->realloc = (void *(*)(void *, size_t))sym[3];
+    b->stats = (int (*)(mm_stats_t *))dlsym(handle, "mm_stats");
+    b->walk = (int (*)(mm_walk_fn, void *))dlsym(handle, "mm_walk");
+    return b;
+}
@@ -0,0 +1,32 @@
+/*
+ * backend.h - the malloc packages mdriver can evaluate (-b)
+ */
+#ifndef __BACKEND_H_
+#define __BACKEND_H_
+
+#include "mm.h"
+
+/*
+ * A malloc package: the mm.h interface of one allocator. mm.c is linked
+ * as it is, as "mm"; the others are built from mm-<name>.c with their
+ * mm_* functions and team renamed to <name>_mm_* and <name>_team (see
+ * BACKENDS in the Makefile), so that they can all live in one binary.
+ * Packages can also be loaded from shared objects at run time.
+ */
+typedef struct {
+    char *name;                             /* as given to -b */
+    team_t *team;                           /* who wrote it, or NULL */
+    int (*init)(void);
+    void *(*malloc)(size_t size);
+    void (*free)(void *ptr);
+    void *(*realloc)(void *ptr, size_t size);
+    int (*stats)(mm_stats_t *stats);        /* mm_stats, or NULL */
+    int (*walk)(mm_walk_fn fn, void *arg);  /* mm_walk, or NULL */
+} backend_t;
+
+extern backend_t backends[];  /* "mm" first; ends with a NULL name */
+
+backend_t *find_backend(char *name);
+backend_t *load_backend(char *path);
+
+#endif /* __BACKEND_H_ */
@@ -0,0 +1,171 @@
+/*
+ * baseline.c - saved results for "mdriver --save-baseline" and
+ *     "mdriver --compare"
+ *
+ * A baseline is a text file, so that it can be kept next to mm.c and
+ * diffed. After a "# mdriver baseline" line and a "# timer" line naming
+ * how it was timed, each line is one package's result on one trace:
+ *
+ *   package trace valid util ops secs spread runs
+ *     p50-malloc p99-malloc p50-free p99-free p50-realloc p99-realloc
+ *
+ * (all on one line). Lines starting with '#' are comments.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "baseline.h"
+
+#define BL_HEADER "# mdriver baseline 1"
+#define BL_LINE   1024
+
+/*
+ * bl_create - create the baseline file path, for results timed with
+ *     timer
+ */
+FILE *bl_create(char *path, char *timer)
+{
+    FILE *fp;
+
+    if ((fp = fopen(path, "w")) == NULL)
+	return NULL;
+    fprintf(fp, "%s\n# timer %s\n", BL_HEADER, timer);
+    fprintf(fp, "# package trace valid util ops secs spread runs "
+	    "p50/p99 of malloc, free and realloc\n");
+    return fp;
+}
+
+/*
+ * bl_checkname - check that a package or trace name can be saved in a
+ *     baseline: each is one token of at most BL_MAXNAME-1 characters.
+ *     Returns 0, with the reason in msg, if it can't.
+ */
+int bl_checkname(char *name, char *msg)
+{
+    if (name[0] == '\0') {
+	sprintf(msg, "Can't save an empty name in a baseline");
+	return 0;
+    }
+    if (strlen(name) >= BL_MAXNAME) {
+	sprintf(msg, "Name too long for a baseline: %.200s...", name);
+	return 0;
+    }
+    if (name[strcspn(name, " \t\n\v\f\r")] != '\0') {
+	sprintf(msg, "Can't save a name with spaces in a baseline: %.200s",
+		name);
+	return 0;
+    }
+    return 1;
+}
+
+/*
+ * bl_write - append the result e
+ */
+void bl_write(FILE *fp, bl_entry_t *e)
+{
+    int t;
+
+    fprintf(fp, "%s %s %d %.6f %.0f %.9g %.6f %d", e->package, e->trace,
+	    e->valid, e->util, e->ops, e->secs, e->spread, e->runs);
+    for (t = 0; t < 3; t++)
+	fprintf(fp, " %llu %llu", e->p50[t], e->p99[t]);
+    fprintf(fp, "\n");
+}
+
+/*
+ * bl_load - read the baseline file path into bl. Returns 0, with the
+ *     reason in msg, if it can't be read or isn't a baseline.
+ */
+int bl_load(char *path, baseline_t *bl, char *msg)
+{
+    char line[BL_LINE];
+    bl_entry_t *e;
+    FILE *fp;
+    int lineno = 0, max = 0;
+
+    if ((fp = fopen(path, "r")) == NULL) {
+	sprintf(msg, "Could not open the baseline %.200s", path);
+	return 0;
+    }
+    bl->n = 0;
+    bl->e = NULL;
+    strcpy(bl->timer, "unknown");
+    while (fgets(line, BL_LINE, fp) != NULL) {
+	lineno++;
+	line[strcspn(line, "\n")] = '\0';
+	if (lineno == 1 && strcmp(line, BL_HEADER)) {
+	    sprintf(msg, "%.200s is not an mdriver baseline", path);
+	    fclose(fp);
+	    return 0;
+	}
+	if (!strncmp(line, "# timer ", 8)) {
+	    if (strlen(line + 8) >= BL_MAXNAME) {
+		sprintf(msg, "%.200s, line %d: timer name too long", path,
+			lineno);
+		fclose(fp);
+		return 0;
+	    }
+	    strcpy(bl->timer, line + 8);
+	    continue;
+	}
+	if (line[0] == '#' || line[0] == '\0')
+	    continue;
+
+	if (bl->n == max) {
+	    max = max ? 2*max : 64;
+	    if ((bl->e = realloc(bl->e, max * sizeof(bl_entry_t))) == NULL) {
+		sprintf(msg, "Out of memory reading %.200s", path);
+		fclose(fp);
+		return 0;
+	    }
+	}
+	e = &bl->e[bl->n];
+	if (sscanf(line, "%255s %255s %d %lf %lf %lf %lf %d "
+		   "%llu %llu %llu %llu %llu %llu", e->package, e->trace,
+		   &e->valid, &e->util, &e->ops, &e->secs, &e->spread,
+		   &e->runs, &e->p50[0], &e->p99[0], &e->p50[1], &e->p99[1],
+		   &e->p50[2], &e->p99[2]) != 14) {
+	    sprintf(msg, "%.200s, line %d: malformed result", path, lineno);
+	    fclose(fp);
+	    return 0;
+	}
+	bl->n++;
+    }
+    fclose(fp);
+    if (lineno == 0) {
+	sprintf(msg, "%.200s is empty", path);
+	return 0;
+    }
+    return 1;
+}
+
+/*
+ * bl_find - returns the result for package on trace, or NULL
+ */
+bl_entry_t *bl_find(baseline_t *bl, char *package, char *trace)
+{
+    int i;
+
+    for (i = 0; i < bl->n; i++)
+	if (!strcmp(bl->e[i].package, package) &&
+	    !strcmp(bl->e[i].trace, trace))
+	    return &bl->e[i];
+    return NULL;
+}
+
+/*
+ * bl_relerr - the standard error of the median of runs timed runs, as
+ *     a fraction of it, given their MAD as a fraction of it (spread).
+ *     The runs are taken to be roughly normal, so their standard
+ *     deviation is 1.4826 MAD, and the median's standard error is
+ *     1.2533 times that over sqrt(runs). Returns -1 if the runs' spread
+ *     isn't known.
+ */
+double bl_relerr(double spread, int runs)
+{
+    if (spread < 0 || runs < 2)
+	return -1;
+    return 1.2533 * 1.4826 * spread / sqrt(runs);
+}
@@ -0,0 +1,54 @@
+/*
+ * baseline.h - saved results for "mdriver --save-baseline" and
+ *     "mdriver --compare"
+ */
+#ifndef __BASELINE_H_
+#define __BASELINE_H_
+
+#include <stdio.h>
+
+#define BL_MAXNAME 256  /* longest package or trace name */
+#define BL_Z       3.0  /* |z| a change in speed must reach to be taken
+			   as more than noise */
+
+/* One mm package's results on one trace */
+typedef struct {
+    char package[BL_MAXNAME];
+    char trace[BL_MAXNAME];
+    int valid;              /* if not, none of the rest is defined */
+    double util;            /* space utilization */
+    double ops;             /* requests in the trace */
+    double secs;            /* time to run them */
+    double spread;          /* MAD of the timed runs over secs, or -1 */
+    int runs;               /* timed runs behind secs, or 0 if not known */
+    unsigned long long p50[3], p99[3]; /* request latencies by type
+					  (malloc, free, realloc), in
+					  timer ticks; 0 if not measured */
+} bl_entry_t;
+
+/* A saved baseline */
+typedef struct {
+    char timer[BL_MAXNAME]; /* how it was timed */
+    int n;                  /* results in it */
+    bl_entry_t *e;
+} baseline_t;
+
+/* Create a baseline file; returns NULL with errno set on error */
+FILE *bl_create(char *path, char *timer);
+
+/* Check a name can be saved; returns 0 with a message in msg if not */
+int bl_checkname(char *name, char *msg);
+
+/* Append one result to it */
+void bl_write(FILE *fp, bl_entry_t *e);
+
+/* Read a baseline file; returns 0 with a message in msg on error */
+int bl_load(char *path, baseline_t *bl, char *msg);
+
+/* The result for package on trace, or NULL */
+bl_entry_t *bl_find(baseline_t *bl, char *package, char *trace);
+
+/* The standard error of a median time, relative to it, or -1 */
+double bl_relerr(double spread, int runs);
+
+#endif /* __BASELINE_H_ */
@@ -0,0 +1,115 @@
+/*
+ * cacheflush.c - evict the CPU caches between cold timed runs
+ *
+ * The caches are flushed by reading one word per line of a buffer half
+ * as large again as the biggest data (or unified) cache in sysfs, which
+ * is usually the last level cache, so that even a cache that doesn't
+ * replace lines in LRU order ends up holding nothing but the buffer.
+ * Reading rather than writing leaves no dirty lines behind for the
+ * timed run to write back. If sysfs doesn't describe the caches,
+ * FLUSH_BYTES are read instead.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cacheflush.h"
+#include "config.h"
+
+#define CACHE_DIR  "/sys/devices/system/cpu/cpu0/cache"
+#define MAX_INDEX  16    /* cache levels (index<n> directories) to look at */
+#define LINE_BYTES 64    /* step through the buffer by this much */
+
+static size_t nbytes = 0;         /* size of the buffer */
+static volatile long *buf = NULL; /* the buffer */
+static volatile long sink;        /* keeps the reads from being optimized out */
+
+/* function prototypes */
+static size_t largest_cache(void);
+static int read_line(char *path, char *line, int len);
+
+/*
+ * flush_bytes - returns the number of bytes flush_caches reads
+ */
+size_t flush_bytes(void)
+{
+    if (nbytes == 0) {
+	nbytes = largest_cache();
+	nbytes = nbytes ? nbytes + nbytes/2 : FLUSH_BYTES;
+    }
+    return nbytes;
+}
+
+/*
+ * flush_caches - read through the buffer, allocating and filling it
+ *     (so that its pages exist) the first time
+ */
+void flush_caches(void)
+{
+    size_t i, n = flush_bytes() / sizeof(long);
+    long x = 0;
+
+    if (buf == NULL) {
+	if ((buf = (volatile long *)malloc(n * sizeof(long))) == NULL) {
+	    fprintf(stderr, "flush_caches: could not allocate %lu bytes\n",
+		    (unsigned long)(n * sizeof(long)));
+	    exit(1);
+	}
+	memset((void *)buf, 1, n * sizeof(long));
+    }
+    for (i = 0; i < n; i += LINE_BYTES / sizeof(long))
+	x += buf[i];
+    sink = x;
+}
+
+/*
+ * The remaining routines are internal helper routines
+ */
+
+/*
+ * largest_cache - returns the size of the largest data or unified
+ *     cache of CPU 0 that sysfs describes, or 0
+ */
+static size_t largest_cache(void)
+{
+    char path[128], line[64], *end;
+    size_t size, largest = 0;
+    int i;
+
+    for (i = 0; i < MAX_INDEX; i++) {
+	sprintf(path, "%s/index%d/type", CACHE_DIR, i);
+	if (!read_line(path, line, sizeof(line)))
+	    break;
+	if (strcmp(line, "Data") && strcmp(line, "Unified"))
+	    continue;
+	sprintf(path, "%s/index%d/size", CACHE_DIR, i);
+	if (!read_line(path, line, sizeof(line)))
+	    continue;
+	size = strtoul(line, &end, 10);
+	if (*end == 'K')
+	    size <<= 10;
+	else if (*end == 'M')
+	    size <<= 20;
+	if (size > largest)
+	    largest = size;
+    }
+    return largest;
+}
+
+/*
+ * read_line - read the first line of a file, less its newline. Returns
+ *     0 if the file can't be read.
+ */
+static int read_line(char *path, char *line, int len)
+{
+    FILE *fp;
+    int ok;
+
+    if ((fp = fopen(path, "r")) == NULL)
+	return 0;
+    ok = (fgets(line, len, fp) != NULL);
+    fclose(fp);
+    if (ok)
+	line[strcspn(line, "\n")] = '\0';
+    return ok;
+}
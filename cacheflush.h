@@ -0,0 +1,15 @@
+/*
+ * cacheflush.h - evict the CPU caches between cold timed runs
+ */
+#ifndef __CACHEFLUSH_H_
+#define __CACHEFLUSH_H_
+
+#include <stddef.h>
+
+/* How many bytes flush_caches reads */
+size_t flush_bytes(void);
+
+/* Evict everything else from the data caches */
+void flush_caches(void);
+
+#endif /* __CACHEFLUSH_H_ */
@@ -0,0 +1,281 @@
+/*
+ * capconv.c - turn a log written by the mcapture preload library into a
+ *     trace file
+ *
+ * Usage: capconv [-b] <logfile> <tracefile>
+ *     -b   Free the blocks still allocated at the end of the log, to
+ *          make a balanced trace.
+ *
+ * Each block gets an id when it is allocated and keeps it through any
+ * reallocs until it is freed, as the trace format requires. Calls that
+ * failed, frees of blocks allocated before the log started (or by
+ * functions mcapture doesn't intercept) and frees of NULL are dropped.
+ * A zero-byte request is recorded as one byte, because the driver
+ * doesn't accept empty payloads. The header fields are computed from
+ * the requests; the suggested heap size is the peak of live bytes. The
+ * trace is written in binary if tracefile ends in TRACE_BIN_EXT.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+
+#include "trace.h"
+#include "capture.h"
+
+#define RECS_PER_READ 4096    /* log records read at a time */
+
+int verbose = 0; /* read by trace.c */
+
+/* A live block, in a linear-probing hash table keyed by address */
+typedef struct {
+    uint64_t addr;            /* its address (0 for an empty slot) */
+    int id;                   /* its trace id */
+    int size;                 /* its payload size */
+} block_t;
+
+static block_t *table = NULL;
+static size_t mask = 0, nlive = 0;
+
+/* The trace being built */
+static trace_t trace;
+static int max_ops = 0;
+static long long live = 0, peak = 0;
+static long dropped = 0;
+
+/* function prototypes */
+static void add_op(int type, int index, int size, int oldsize);
+static block_t *find_block(uint64_t addr);
+static void insert_block(uint64_t addr, int id, int size);
+static void remove_block(block_t *b);
+static void usage(void);
+
+int main(int argc, char **argv)
+{
+    FILE *fp;
+    cap_rec_t recs[RECS_PER_READ], *r;
+    char magic[8];
+    block_t *b;
+    size_t n, i;
+    int c, balance = 0, size;
+
+    while ((c = getopt(argc, argv, "bh")) != EOF) {
+	switch (c) {
+	case 'b':
+	    balance = 1;
+	    break;
+	default:
+	    usage();
+	    exit(c != 'h');
+	}
+    }
+    if (argc - optind != 2) {
+	usage();
+	exit(1);
+    }
+
+    if ((fp = fopen(argv[optind], "r")) == NULL) {
+	printf("Could not open %s: %s\n", argv[optind], strerror(errno));
+	exit(1);
+    }
+    if (fread(magic, 1, 8, fp) != 8 || memcmp(magic, CAP_MAGIC, 8)) {
+	printf("%s is not an mcapture log\n", argv[optind]);
+	exit(1);
+    }
+    trace.weight = 1;
+    insert_block(0, 0, 0); /* size the table; address 0 is never live */
+
+    while ((n = fread(recs, sizeof(cap_rec_t), RECS_PER_READ, fp)) > 0) {
+	for (i = 0; i < n; i++) {
+	    r = &recs[i];
+	    size = (r->size == 0) ? 1 :
+		(r->size > INT_MAX) ? INT_MAX : (int)r->size;
+	    switch (r->type) {
+	    case CAP_MALLOC:
+		if (r->addr == 0) {
+		    dropped++;
+		    break;
+		}
+		/* the address can't be live; if it is, we missed a free */
+		if ((b = find_block(r->addr)) != NULL) {
+		    add_op(FREE, b->id, 0, b->size);
+		    remove_block(b);
+		}
+		add_op(ALLOC, trace.num_ids, size, 0);
+		insert_block(r->addr, trace.num_ids++, size);
+		break;
+
+	    case CAP_REALLOC:
+		b = (r->old != 0) ? find_block(r->old) : NULL;
+		if (r->addr == 0) {
+		    /* realloc(p, 0) may free p; a failed realloc doesn't */
+		    if (b != NULL && r->size == 0) {
+			add_op(FREE, b->id, 0, b->size);
+			remove_block(b);
+		    }
+		    else
+			dropped++;
+		    break;
+		}
+		if (b == NULL) {
+		    /* realloc(NULL, n), or of a block we never saw */
+		    if ((b = find_block(r->addr)) != NULL) {
+			add_op(FREE, b->id, 0, b->size);
+			remove_block(b);
+		    }
+		    add_op(ALLOC, trace.num_ids, size, 0);
+		    insert_block(r->addr, trace.num_ids++, size);
+		    break;
+		}
+		add_op(REALLOC, b->id, size, b->size);
+		c = b->id;
+		remove_block(b);
+		if ((b = find_block(r->addr)) != NULL) {
+		    add_op(FREE, b->id, 0, b->size);
+		    remove_block(b);
+		}
+		insert_block(r->addr, c, size);
+		break;
+
+	    case CAP_FREE:
+		if ((b = find_block(r->addr)) == NULL) {
+		    dropped++;
+		    break;
+		}
+		add_op(FREE, b->id, 0, b->size);
+		remove_block(b);
+		break;
+
+	    default:
+		printf("Bad record in %s\n", argv[optind]);
+		exit(1);
+	    }
+	}
+    }
+    fclose(fp);
+
+    /* Free whatever is left */
+    if (balance) {
+	for (i = 0; i <= mask; i++)
+	    if (table[i].addr != 0)
+		add_op(FREE, table[i].id, 0, table[i].size);
+    }
+
+    trace.sugg_heapsize = (peak > INT_MAX) ? INT_MAX : (int)peak;
+    if (write_trace(&trace, argv[optind+1]) < 0) {
+	printf("Could not write %s: %s\n", argv[optind+1], strerror(errno));
+	exit(1);
+    }
+    printf("%s -> %s: %d requests, %d blocks, peak %lld bytes live, "
+	   "%ld calls dropped\n", argv[optind], argv[optind+1],
+	   trace.num_ops, trace.num_ids, peak, dropped);
+    exit(0);
+}
+
+/*
+ * add_op - append a request to the trace and track the live bytes. A
+ *     block that was oldsize bytes becomes size bytes (0 for a free).
+ */
+static void add_op(int type, int index, int size, int oldsize)
+{
+    traceop_t *op;
+
+    if (trace.num_ops == max_ops) {
+	max_ops = max_ops ? 2*max_ops : 1<<16;
+	trace.ops = (traceop_t *)realloc(trace.ops,
+					 max_ops * sizeof(traceop_t));
+	if (trace.ops == NULL) {
+	    printf("capconv: out of memory\n");
+	    exit(1);
+	}
+    }
+    op = &trace.ops[trace.num_ops++];
+    op->type = type;
+    op->index = index;
+    op->size = size;
+
+    live += size - oldsize;
+    if (live > peak)
+	peak = live;
+}
+
+/*
+ * find_block - returns the live block at addr, or NULL
+ */
+static block_t *find_block(uint64_t addr)
+{
+    size_t i;
+
+    for (i = (addr >> 4) * 0x9e3779b97f4a7c15ULL & mask;
+	 table[i].addr != 0; i = (i + 1) & mask)
+	if (table[i].addr == addr)
+	    return &table[i];
+    return NULL;
+}
+
+/*
+ * insert_block - add a live block, growing the table when it gets half
+ *     full. An addr of 0 only sizes the table.
+ */
+static void insert_block(uint64_t addr, int id, int size)
+{
+    block_t *old = table;
+    size_t oldmask = mask, i;
+
+    if (table == NULL || 2*(nlive + 1) > mask + 1) {
+	mask = table ? 2*mask + 1 : 1023;
+	if ((table = (block_t *)calloc(mask + 1, sizeof(block_t))) == NULL) {
+	    printf("capconv: out of memory\n");
+	    exit(1);
+	}
+	nlive = 0;
+	if (old != NULL) {
+	    for (i = 0; i <= oldmask; i++)
+		if (old[i].addr != 0)
+		    insert_block(old[i].addr, old[i].id, old[i].size);
+	    free(old);
+	}
+    }
+    if (addr == 0)
+	return;
+    for (i = (addr >> 4) * 0x9e3779b97f4a7c15ULL & mask;
+	 table[i].addr != 0; i = (i + 1) & mask)
+	;
+    table[i].addr = addr;
+    table[i].id = id;
+    table[i].size = size;
+    nlive++;
+}
+
+/*
+ * remove_block - delete a block from the table, shifting back the
+ *     entries after it so that lookups never stop early
+ */
+static void remove_block(block_t *b)
+{
+    size_t i = b - table, j = i, home;
+
+    table[i].addr = 0;
+    for (;;) {
+	j = (j + 1) & mask;
+	if (table[j].addr == 0)
+	    break;
+	home = (table[j].addr >> 4) * 0x9e3779b97f4a7c15ULL & mask;
+	if (((j - home) & mask) >= ((j - i) & mask)) {
+	    table[i] = table[j];
+	    table[j].addr = 0;
+	    i = j;
+	}
+    }
+    nlive--;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: capconv [-b] <logfile> <tracefile>\n");
+    fprintf(stderr, "\t-b   Free blocks still allocated at the end.\n");
+    fprintf(stderr, "Tracefiles ending in %s are binary, all others are "
+	    "text.\n", TRACE_BIN_EXT);
+}
@@ -0,0 +1,30 @@
+/*
+ * capture.h - the log written by the mcapture preload library and read
+ *     by capconv
+ *
+ * A log is CAP_MAGIC followed by one cap_rec_t per call, in the order
+ * the calls took effect. All fields have fixed widths, so a log written
+ * by a 64-bit program can be read by a 32-bit capconv.
+ */
+#ifndef __CAPTURE_H_
+#define __CAPTURE_H_
+
+#include <stdint.h>
+
+#define CAP_MAGIC   "MCAP0001"   /* 8 bytes at the start of each log */
+#define CAP_EXT     ".cap"       /* log file names are <prefix>.<pid>.cap */
+
+/* Types of call */
+#define CAP_MALLOC  0            /* also calloc, memalign and friends */
+#define CAP_FREE    1
+#define CAP_REALLOC 2
+
+typedef struct {
+    uint64_t addr;    /* block returned (free: block freed), or 0 */
+    uint64_t old;     /* block passed to realloc */
+    uint64_t size;    /* bytes requested */
+    uint32_t type;    /* CAP_MALLOC, CAP_FREE or CAP_REALLOC */
+    uint32_t pad;
+} cap_rec_t;
+
+#endif /* __CAPTURE_H_ */
@@ -58,15 +58,43 @@
 #define ALIGNMENT 8  
 
 /* 
- * Maximum heap size in bytes 
+ * Default maximum heap size in bytes. The driver reserves this much
+ * address space for the simulated heap; override it with -m.
  */
 #define MAX_HEAP (20*(1<<20))  /* 20 MB */
 
+/*
+ * Granularity in bytes with which pages of the heap reservation are
+ * committed as mem_sbrk advances the brk pointer.
+ */
+#define COMMIT_CHUNK (1<<16)   /* 64 KB */
+
+/*
+ * Size and alignment in bytes of a transparent huge page. Used when
+ * the heap is backed by huge pages (-H).
+ */
+#define HUGEPAGE_SIZE (1<<21)  /* 2 MB */
+
+/*
+ * Bytes read to flush the caches between cold runs (--cold) when the
+ * cache sizes can't be found in sysfs.
+ */
+#define FLUSH_BYTES (64*(1<<20))  /* 64 MB */
+
+/*
+ * How far a trace's throughput (percent) and space utilization
+ * (percentage points) may fall below a --compare baseline before the
+ * driver calls it a regression. Override them with --tolerance.
+ */
+#define TOL_KOPS 5.0   /* percent */
+#define TOL_UTIL 1.0   /* percentage points */
+
 /*****************************************************************************
  * Set exactly one of these USE_xxx constants to "1" to select a timing method
  *****************************************************************************/
 #define USE_FCYC   0   /* cycle counter w/K-best scheme (x86 & Alpha only) */
 #define USE_ITIMER 0   /* interval timer (any Unix box) */
-#define USE_GETTOD 1   /* gettimeofday (any Unix box) */
+#define USE_GETTOD 0   /* gettimeofday (any Unix box) */
+#define USE_STAT   1   /* rdtscp or monotonic clock, median of adaptive runs */
 
 #endif /* __CONFIG_H */
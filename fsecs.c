@@ -6,9 +6,15 @@
 #include "fcyc.h"
 #include "clock.h"
 #include "ftimer.h"
+#include "cacheflush.h"
 #include "config.h"
 
 static double Mhz;  /* estimated CPU clock frequency */
+static int flush;   /* flush the caches before each run? */
+#if USE_STAT
+static ftimer_stat_t last; /* how the last fsecs measurement went */
+static char method[64];    /* what fsecs_method returns */
+#endif
 
 extern int verbose; /* -v option in mdriver.c */
 
@@ -36,6 +42,67 @@ void init_fsecs(void)
 #elif USE_GETTOD
     if (verbose)
 	printf("Measuring performance with gettimeofday().\n");
+#elif USE_STAT
+    ftimer_stat_init();
+    sprintf(method, "%s, median of runs", ftimer_stat_clock());
+    if (verbose)
+	printf("Measuring performance with %s.\n", method);
+#endif
+}
+
+/*
+ * fsecs_method - Return the name of the timer fsecs uses
+ */
+char *fsecs_method(void)
+{
+#if USE_FCYC
+    return "cycle counter";
+#elif USE_ITIMER
+    return "interval timer";
+#elif USE_GETTOD
+    return "gettimeofday";
+#elif USE_STAT
+    return method;
+#endif
+}
+
+/*
+ * fsecs_spread - Return the median absolute deviation of the runs 
+ *     behind the last fsecs result, as a fraction of it, or -1 if the
+ *     timer doesn't measure it
+ */
+double fsecs_spread(void)
+{
+#if USE_STAT
+    return last.median > 0 ? last.mad / last.median : 0;
+#else
+    return -1;
+#endif
+}
+
+/*
+ * fsecs_runs - Return the number of runs (outliers aside) behind the
+ *     last fsecs result, or 0 if the timer doesn't report it
+ */
+int fsecs_runs(void)
+{
+#if USE_STAT
+    return last.runs - last.outliers;
+#else
+    return 0;
+#endif
+}
+
+/*
+ * set_fsecs_flush - Flush the caches before each run fsecs times, so 
+ *     that it measures cold-cache rather than warm-cache running time
+ */
+void set_fsecs_flush(int f)
+{
+    flush = f;
+#if USE_FCYC
+    /* fcyc clears a small cache before each sample anyway */
+    set_fcyc_cache_size(flush ? (int)flush_bytes() : 1<<19);
 #endif
 }
 
@@ -47,10 +114,26 @@ double fsecs(fsecs_test_funct f, void *argp)
 #if USE_FCYC
     double cycles = fcyc(f, argp);
     return cycles/(Mhz*1e6);
-#elif USE_ITIMER
-    return ftimer_itimer(f, argp, 10);
-#elif USE_GETTOD
-    return ftimer_gettod(f, argp, 10);
+#elif USE_ITIMER || USE_GETTOD
+    double secs = 0;
+    int i;
+
+    if (!flush)
+	return USE_ITIMER ? ftimer_itimer(f, argp, 10) :
+	    ftimer_gettod(f, argp, 10);
+    for (i = 0; i < 10; i++) {
+	flush_caches();
+	secs += USE_ITIMER ? ftimer_itimer(f, argp, 1) :
+	    ftimer_gettod(f, argp, 1);
+    }
+    return secs / 10;
+#elif USE_STAT
+    ftimer_stat(f, argp, flush ? flush_caches : NULL, &last);
+    if (verbose > 1)
+	printf("Timed %d runs (%d outliers): median %.1f us, "
+	       "MAD %.1f%%, 95%% CI +/-%.1f%%\n", last.runs, last.outliers,
+	       last.median*1e6, fsecs_spread()*100, last.ci*100);
+    return last.median;
 #endif 
 }
 
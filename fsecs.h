@@ -2,3 +2,7 @@ typedef void (*fsecs_test_funct)(void *);
 
 void init_fsecs(void);
 double fsecs(fsecs_test_funct f, void *argp);
+char *fsecs_method(void);
+double fsecs_spread(void);
+int fsecs_runs(void);
+void set_fsecs_flush(int flush);
@@ -7,14 +7,47 @@
  * Function timers that estimate the running time (in seconds) of a function f.
  *    ftimer_itimer: version that uses the interval timer
  *    ftimer_gettod: version that uses gettimeofday
+ *    ftimer_stat:   version that uses rdtscp or clock_gettime, with
+ *                   warmup, adaptive repetition and outlier rejection
  */
 #include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
 #include <sys/time.h>
+#if defined(__i386__) || defined(__x86_64__)
+#include <cpuid.h>
+#endif
 #include "ftimer.h"
 
+/* 
+ * Parameters of ftimer_stat. After STAT_WARMUP untimed runs, f is run
+ * at least STAT_MIN_RUNS times, and then until the 95% confidence
+ * interval of the mean is within STAT_EPSILON of it, STAT_MAX_RUNS
+ * runs have been made or STAT_MAX_SECS have gone by. Runs more than
+ * STAT_OUTLIER (scaled) median absolute deviations from the median are
+ * left out, as they are most likely interrupted or migrated.
+ */
+#define STAT_WARMUP    2
+#define STAT_MIN_RUNS  5
+#define STAT_MAX_RUNS  100
+#define STAT_EPSILON   0.01
+#define STAT_MAX_SECS  2.0
+#define STAT_OUTLIER   3.0
+#define STAT_CALIBRATE 0.02   /* secs to calibrate the TSC against */
+
+#ifndef CLOCK_MONOTONIC_RAW
+#define CLOCK_MONOTONIC_RAW CLOCK_MONOTONIC
+#endif
+
 /* function prototypes */
 static void init_etime(void);
 static double get_etime(void);
+static double stat_secs(void);
+static unsigned long long stat_ticks(void);
+static int has_invariant_tsc(void);
+static void stat_summarize(double *v, int n, ftimer_stat_t *st);
+static int cmp_double(const void *a, const void *b);
 
 /* 
  * ftimer_itimer - Use the interval timer to estimate the running time
@@ -53,6 +86,183 @@ double ftimer_gettod(ftimer_test_funct f, void *argp, int n)
 }
 
 
+/*
+ * Routines for the statistical timer
+ */
+
+/* Seconds per tick of stat_ticks, or 0 to read the clock instead */
+static double tsc_secs = 0;
+
+/* 
+ * ftimer_stat_init - Use rdtscp if the CPU has it and an invariant TSC
+ * (one that ticks at a fixed rate whatever the clock speed or power
+ * state), after measuring its rate against CLOCK_MONOTONIC_RAW.
+ * Otherwise ftimer_stat reads the clock itself.
+ */
+void ftimer_stat_init(void)
+{
+    unsigned long long t0, t1;
+    double s0, s1;
+
+    tsc_secs = 0;
+    if (!has_invariant_tsc())
+	return;
+    s0 = stat_secs();
+    t0 = stat_ticks();
+    do
+	s1 = stat_secs();
+    while (s1 - s0 < STAT_CALIBRATE);
+    t1 = stat_ticks();
+    if (t1 > t0)
+	tsc_secs = (s1 - s0) / (t1 - t0);
+}
+
+/*
+ * ftimer_stat_clock - Return the name of the clock ftimer_stat reads
+ */
+char *ftimer_stat_clock(void)
+{
+    return tsc_secs ? "rdtscp" : "clock_gettime(CLOCK_MONOTONIC_RAW)";
+}
+
+/* 
+ * ftimer_stat - Estimate the running time of f(argp) as the median of
+ * repeated runs; see STAT_xxx for how many. If prep isn't NULL, it is
+ * called (untimed) before each timed run. Return the estimate in
+ * seconds, and if st isn't NULL fill it in.
+ */
+double ftimer_stat(ftimer_test_funct f, void *argp, void (*prep)(void),
+		   ftimer_stat_t *st)
+{
+    double v[STAT_MAX_RUNS], start, s0;
+    unsigned long long t0;
+    ftimer_stat_t stat;
+    int i, n;
+
+    for (i = 0; i < STAT_WARMUP; i++)
+	f(argp);
+
+    start = stat_secs();
+    for (n = 0; n < STAT_MAX_RUNS; ) {
+	if (prep != NULL)
+	    prep();
+	if (tsc_secs) {
+	    t0 = stat_ticks();
+	    f(argp);
+	    v[n++] = (stat_ticks() - t0) * tsc_secs;
+	}
+	else {
+	    s0 = stat_secs();
+	    f(argp);
+	    v[n++] = stat_secs() - s0;
+	}
+	if (n < STAT_MIN_RUNS)
+	    continue;
+	stat_summarize(v, n, &stat);
+	if (stat.ci <= STAT_EPSILON || stat_secs() - start > STAT_MAX_SECS)
+	    break;
+    }
+
+    if (st != NULL)
+	*st = stat;
+    return stat.median;
+}
+
+/* stat_secs - Read CLOCK_MONOTONIC_RAW, in seconds */
+static double stat_secs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return ts.tv_sec + 1e-9*ts.tv_nsec;
+}
+
+/* 
+ * stat_ticks - Read the TSC with rdtscp, which waits for the code
+ * being timed to finish first. Only called if has_invariant_tsc.
+ */
+static unsigned long long stat_ticks(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    unsigned lo, hi, aux;
+
+    __asm__ __volatile__("rdtscp" : "=a" (lo), "=d" (hi), "=c" (aux));
+    return ((unsigned long long)hi << 32) | lo;
+#else
+    return 0;
+#endif
+}
+
+/* has_invariant_tsc - Does the CPU have rdtscp and an invariant TSC? */
+static int has_invariant_tsc(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    unsigned a, b, c, d;
+
+    if (__get_cpuid(0x80000000, &a, &b, &c, &d) == 0 || a < 0x80000007)
+	return 0;
+    __get_cpuid(0x80000001, &a, &b, &c, &d);
+    if (!(d & (1 << 27)))        /* rdtscp */
+	return 0;
+    __get_cpuid(0x80000007, &a, &b, &c, &d);
+    return (d & (1 << 8)) != 0;  /* invariant TSC */
+#else
+    return 0;
+#endif
+}
+
+/* 
+ * stat_summarize - Describe the n run times in v (which get sorted):
+ * reject the outliers and work out the median, MAD and confidence 
+ * interval of the rest
+ */
+static void stat_summarize(double *v, int n, ftimer_stat_t *st)
+{
+    /* two-sided 95% quantiles of Student's t for 1..30 degrees of freedom */
+    static double t95[30] = {
+	12.71, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+	2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+	2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+    };
+    double dev[STAT_MAX_RUNS], med, mad, limit, sum = 0, sumsq = 0, mean, sd;
+    int i, lo, hi, k;
+
+    qsort(v, n, sizeof(double), cmp_double);
+    med = (v[(n-1)/2] + v[n/2]) / 2;
+    for (i = 0; i < n; i++)
+	dev[i] = fabs(v[i] - med);
+    qsort(dev, n, sizeof(double), cmp_double);
+    mad = (dev[(n-1)/2] + dev[n/2]) / 2;
+
+    /* 1.4826 * MAD estimates the standard deviation of normal data */
+    limit = STAT_OUTLIER * 1.4826 * mad;
+    for (lo = 0; med - v[lo] > limit; lo++)
+	;
+    for (hi = n; v[hi-1] - med > limit; hi--)
+	;
+    k = hi - lo;
+    for (i = lo; i < hi; i++) {
+	sum += v[i];
+	sumsq += v[i] * v[i];
+    }
+    mean = sum / k;
+    sd = (k > 1 && sumsq > sum * mean) ? sqrt((sumsq - sum * mean) / (k-1)) : 0;
+
+    st->runs = n;
+    st->outliers = n - k;
+    st->median = (v[lo + (k-1)/2] + v[lo + k/2]) / 2;
+    st->mad = mad;
+    st->ci = (k > 1 && mean > 0) ? 
+	(k-1 <= 30 ? t95[k-2] : 1.96) * sd / sqrt(k) / mean : 0;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
 /*
  * Routines for manipulating the Unix interval timer
  */
@@ -12,3 +12,25 @@ double ftimer_itimer(ftimer_test_funct f, void *argp, int n);
    Return the average of n runs */
 double ftimer_gettod(ftimer_test_funct f, void *argp, int n);
 
+/* How the runs behind an ftimer_stat estimate were distributed */
+typedef struct {
+    int runs;         /* timed runs, after the warmup ones */
+    int outliers;     /* runs rejected as outliers */
+    double median;    /* median time of the runs kept (secs) */
+    double mad;       /* their median absolute deviation (secs) */
+    double ci;        /* half-width of the 95% confidence interval of 
+			 their mean, as a fraction of the mean */
+} ftimer_stat_t;
+
+/* Pick and calibrate the clock used by ftimer_stat */
+void ftimer_stat_init(void);
+
+/* Describe that clock */
+char *ftimer_stat_clock(void);
+
+/* Estimate the running time of f(argp) with rdtscp or clock_gettime,
+   repeating it until the estimate is stable, and calling prep (if not
+   NULL) before each run. Return the median run and, if st isn't NULL,
+   describe the runs in *st */
+double ftimer_stat(ftimer_test_funct f, void *argp, void (*prep)(void),
+		   ftimer_stat_t *st);
@@ -0,0 +1,177 @@
+/*
+ * heapsnap.c - heap snapshots, written by "mdriver --snapshot" and read
+ *     by snapview
+ *
+ * The allocator walks its own blocks (mm_walk, which follows mm.c's
+ * boundary tags) and snap_write turns each one into a record as it
+ * goes, so nothing the size of the heap is ever held in memory. The
+ * block count isn't known until the walk is done, so it is filled into
+ * the snapshot header afterwards.
+ */
+#define _FILE_OFFSET_BITS 64  /* snapshots of big heaps run past 2GB */
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "heapsnap.h"
+
+/* What snap_write's walk callback needs */
+typedef struct {
+    FILE *fp;
+    char *lo;                       /* start of the heap */
+    unsigned long long nblocks;     /* blocks written so far */
+} walk_t;
+
+/* function prototypes */
+static void put_block(void *payload, size_t size, int alloc, void *arg);
+static void put_u64(unsigned char *b, unsigned long long v);
+static unsigned long long get_u64(unsigned char *b);
+
+/*
+ * snap_create - create the snapshot file path and write its header
+ */
+FILE *snap_create(char *path)
+{
+    unsigned char b[8] = {0};
+    FILE *fp;
+
+    if ((fp = fopen(path, "w")) == NULL)
+	return NULL;
+    memcpy(b, SNAP_MAGIC, 4);
+    b[4] = SNAP_VERSION;
+    fwrite(b, 1, 8, fp);
+    return fp;
+}
+
+/*
+ * snap_write - append a snapshot of the heap_bytes heap at heap_lo, made
+ *     after op requests with live_bytes of payload live. Returns -1 on
+ *     error.
+ */
+int snap_write(FILE *fp, unsigned long long op, void *heap_lo,
+	       size_t heap_bytes, size_t live_bytes,
+	       int (*walk)(mm_walk_fn fn, void *arg))
+{
+    unsigned char b[SNAP_HDRSIZE];
+    walk_t w;
+    off_t at;
+
+    w.fp = fp;
+    w.lo = (char *)heap_lo;
+    w.nblocks = 0;
+
+    /* the header, with the block count left for later */
+    at = ftello(fp);
+    put_u64(b, op);
+    put_u64(b + 8, (unsigned long long)(size_t)w.lo);
+    put_u64(b + 16, heap_bytes);
+    put_u64(b + 24, live_bytes);
+    put_u64(b + 32, 0);
+    fwrite(b, 1, SNAP_HDRSIZE, fp);
+
+    if (walk(put_block, &w) < 0)
+	return -1;
+
+    put_u64(b, w.nblocks);
+    if (fseeko(fp, at + 32, SEEK_SET) < 0 || fwrite(b, 1, 8, fp) != 8 ||
+	fseeko(fp, 0, SEEK_END) < 0)
+	return -1;
+    return ferror(fp) ? -1 : 0;
+}
+
+/*
+ * snap_open - open the snapshot file path and check its header
+ */
+FILE *snap_open(char *path)
+{
+    unsigned char b[8];
+    FILE *fp;
+
+    if ((fp = fopen(path, "r")) == NULL)
+	return NULL;
+    if (fread(b, 1, 8, fp) != 8 || memcmp(b, SNAP_MAGIC, 4) ||
+	b[4] != SNAP_VERSION) {
+	fclose(fp);
+	return NULL;
+    }
+    return fp;
+}
+
+/*
+ * snap_next - read the header of the next snapshot. The caller must
+ *     have read all the blocks of the one before.
+ */
+int snap_next(FILE *fp, snap_hdr_t *hdr)
+{
+    unsigned char b[SNAP_HDRSIZE];
+
+    if (fread(b, 1, SNAP_HDRSIZE, fp) != SNAP_HDRSIZE)
+	return 0;
+    hdr->op = get_u64(b);
+    hdr->heap_lo = get_u64(b + 8);
+    hdr->heap_bytes = get_u64(b + 16);
+    hdr->live_bytes = get_u64(b + 24);
+    hdr->nblocks = get_u64(b + 32);
+    return 1;
+}
+
+/*
+ * snap_block - read the next block of the current snapshot
+ */
+int snap_block(FILE *fp, snap_block_t *blk)
+{
+    unsigned char b[SNAP_BLKSIZE];
+
+    if (fread(b, 1, SNAP_BLKSIZE, fp) != SNAP_BLKSIZE)
+	return 0;
+    blk->offset = get_u64(b);
+    blk->size = get_u64(b + 8);
+    blk->alloc = b[16] & SNAP_ALLOC;
+    return 1;
+}
+
+/*
+ * snap_skip - skip over the blocks of the snapshot whose header was
+ *     just read
+ */
+int snap_skip(FILE *fp, snap_hdr_t *hdr)
+{
+    return fseeko(fp, (off_t)(hdr->nblocks * SNAP_BLKSIZE), SEEK_CUR) == 0;
+}
+
+/*
+ * The remaining routines are internal helper routines
+ */
+
+/* put_block - write one block record; the mm_walk callback */
+static void put_block(void *payload, size_t size, int alloc, void *arg)
+{
+    walk_t *w = (walk_t *)arg;
+    unsigned char b[SNAP_BLKSIZE];
+
+    put_u64(b, (unsigned long long)((char *)payload - w->lo));
+    put_u64(b + 8, size);
+    b[16] = alloc ? SNAP_ALLOC : 0;
+    fwrite(b, 1, SNAP_BLKSIZE, w->fp);
+    w->nblocks++;
+}
+
+/* put_u64 - store v little endian */
+static void put_u64(unsigned char *b, unsigned long long v)
+{
+    int i;
+
+    for (i = 0; i < 8; i++, v >>= 8)
+	b[i] = (unsigned char)v;
+}
+
+/* get_u64 - load a little endian value */
+static unsigned long long get_u64(unsigned char *b)
+{
+    unsigned long long v = 0;
+    int i;
+
+    for (i = 7; i >= 0; i--)
+	v = (v << 8) | b[i];
+    return v;
+}
@@ -0,0 +1,70 @@
+/*
+ * heapsnap.h - heap snapshots, written by "mdriver --snapshot" and read
+ *     by snapview
+ */
+#ifndef __HEAPSNAP_H_
+#define __HEAPSNAP_H_
+
+#include <stdio.h>
+
+#include "mm.h"
+
+/*
+ * Snapshot file format. All fields are little endian.
+ *
+ *   bytes 0-3    SNAP_MAGIC
+ *   byte  4      SNAP_VERSION
+ *   bytes 5-7    reserved (0)
+ *
+ * followed by any number of snapshots, each a header of SNAP_HDRSIZE
+ * bytes: the number of requests made before it, the heap's start
+ * address, its size, the payload bytes the trace had live and the
+ * number of blocks (int64 each); then that many blocks in address
+ * order, each the offset of its payload from the start of the heap and
+ * the payload size as the allocator sees it (int64 each), and a flags
+ * byte (SNAP_ALLOC if it is allocated). The bytes between one payload
+ * and the next are the allocator's overhead (headers, footers, padding).
+ */
+#define SNAP_MAGIC    "MSNP"
+#define SNAP_VERSION  1
+#define SNAP_HDRSIZE  40
+#define SNAP_BLKSIZE  17
+#define SNAP_ALLOC    0x1
+
+/* One snapshot's header */
+typedef struct {
+    unsigned long long op;          /* requests made before it */
+    unsigned long long heap_lo;     /* address of the heap's first byte */
+    unsigned long long heap_bytes;  /* heap size */
+    unsigned long long live_bytes;  /* payload bytes the trace had live */
+    unsigned long long nblocks;     /* blocks that follow */
+} snap_hdr_t;
+
+/* One block */
+typedef struct {
+    unsigned long long offset;      /* of its payload from heap_lo */
+    unsigned long long size;        /* its payload size */
+    int alloc;                      /* is it allocated? */
+} snap_block_t;
+
+/* Create a snapshot file; returns NULL with errno set on error */
+FILE *snap_create(char *path);
+
+/* Append a snapshot of the heap at heap_lo, walking it with walk */
+int snap_write(FILE *fp, unsigned long long op, void *heap_lo,
+	       size_t heap_bytes, size_t live_bytes,
+	       int (*walk)(mm_walk_fn fn, void *arg));
+
+/* Open a snapshot file for reading; returns NULL if it isn't one */
+FILE *snap_open(char *path);
+
+/* Read the next snapshot's header; returns 0 at the end of the file */
+int snap_next(FILE *fp, snap_hdr_t *hdr);
+
+/* Read the next block of the current snapshot; returns 0 on error */
+int snap_block(FILE *fp, snap_block_t *blk);
+
+/* Skip the blocks of the current snapshot; returns 0 on error */
+int snap_skip(FILE *fp, snap_hdr_t *hdr);
+
+#endif /* __HEAPSNAP_H_ */
@@ -0,0 +1,125 @@
+/*
+ * latency.c - per-request latency histograms
+ *
+ * The replay loop reads the timer (lat_ticks) around every request and
+ * records the difference, less the timer's own overhead, here. Samples
+ * go into a fixed array of log-linear buckets, so recording is cheap
+ * and the memory used doesn't depend on the trace length.
+ */
+#include <string.h>
+
+#include "latency.h"
+
+#define SUB        (1 << LAT_SUB_BITS)  /* buckets per power of two */
+#define OVHD_RUNS  10000                /* samples taken by lat_overhead */
+
+/* function prototypes */
+static int bucket(unsigned long long t);
+static unsigned long long bucket_top(int b);
+static unsigned long long percentile(lat_hist_t *h, double q);
+
+/*
+ * lat_overhead - returns the median number of ticks between two
+ *     consecutive reads of the timer. This is what timing an empty
+ *     request would report, so it is subtracted from every sample.
+ */
+unsigned long long lat_overhead(void)
+{
+    lat_hist_t h;
+    unsigned long long t0, t1;
+    int i;
+
+    lat_reset(&h);
+    for (i = 0; i < OVHD_RUNS; i++) {
+	t0 = lat_ticks();
+	t1 = lat_ticks();
+	lat_record(&h, t1 - t0);
+    }
+    return percentile(&h, 0.5);
+}
+
+/*
+ * lat_reset - empty a histogram
+ */
+void lat_reset(lat_hist_t *h)
+{
+    memset(h, 0, sizeof(lat_hist_t));
+}
+
+/*
+ * lat_record - add a sample of t ticks to a histogram
+ */
+void lat_record(lat_hist_t *h, unsigned long long t)
+{
+    h->count[bucket(t)]++;
+    h->n++;
+    if (t > h->max)
+	h->max = t;
+}
+
+/*
+ * lat_summarize - fill in *s with the percentiles of a histogram. Each
+ *     percentile is the top of the bucket it falls in, capped at the
+ *     largest sample.
+ */
+void lat_summarize(lat_hist_t *h, lat_summary_t *s)
+{
+    s->n = h->n;
+    s->p50 = percentile(h, 0.5);
+    s->p90 = percentile(h, 0.9);
+    s->p99 = percentile(h, 0.99);
+    s->p999 = percentile(h, 0.999);
+    s->max = h->max;
+}
+
+/*
+ * The remaining routines are internal helper routines
+ */
+
+/*
+ * bucket - returns the bucket that t falls in
+ */
+static int bucket(unsigned long long t)
+{
+    int shift;
+
+    if (t < SUB)
+	return (int)t;
+    shift = 63 - __builtin_clzll(t) - LAT_SUB_BITS;
+    return ((shift + 1) << LAT_SUB_BITS) + (int)((t >> shift) & (SUB - 1));
+}
+
+/*
+ * bucket_top - returns the largest value that falls in bucket b
+ */
+static unsigned long long bucket_top(int b)
+{
+    int shift;
+
+    if (b < SUB)
+	return b;
+    shift = (b >> LAT_SUB_BITS) - 1;
+    return (((unsigned long long)(SUB + (b & (SUB - 1))) + 1) << shift) - 1;
+}
+
+/*
+ * percentile - returns the value below which a fraction q of the
+ *     samples fall
+ */
+static unsigned long long percentile(lat_hist_t *h, double q)
+{
+    unsigned long long rank, seen = 0;
+    int b;
+
+    if (h->n == 0)
+	return 0;
+    rank = (unsigned long long)(q * h->n);
+    if (rank < q * h->n || rank < 1)
+	rank++;
+    for (b = 0; b < LAT_BUCKETS; b++) {
+	seen += h->count[b];
+	if (seen >= rank)
+	    return bucket_top(b) < h->max ? bucket_top(b) : h->max;
+    }
+    return h->max;
+}
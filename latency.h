@@ -0,0 +1,66 @@
+/*
+ * latency.h - per-request latency histograms
+ */
+#ifndef __LATENCY_H_
+#define __LATENCY_H_
+
+/*
+ * Latencies are binned log-linearly: values below 2^LAT_SUB_BITS get a
+ * bucket each, and every power of two above that is split into
+ * 2^LAT_SUB_BITS equal buckets, so any bucket is within 1/16 of the
+ * values it holds.
+ */
+#define LAT_SUB_BITS 4
+#define LAT_BUCKETS  (64 << LAT_SUB_BITS)
+
+typedef struct {
+    unsigned long long count[LAT_BUCKETS]; /* samples in each bucket */
+    unsigned long long n;                  /* total samples */
+    unsigned long long max;                /* largest sample */
+} lat_hist_t;
+
+/* Percentiles of a histogram, in timer ticks */
+typedef struct {
+    unsigned long long n;
+    unsigned long long p50, p90, p99, p999;
+    unsigned long long max;
+} lat_summary_t;
+
+/*
+ * lat_ticks - read the timer: the time stamp counter on x86, otherwise
+ *     the monotonic clock in ns. Inline, as it brackets every request.
+ */
+#if defined(__i386__) || defined(__x86_64__)
+static inline unsigned long long lat_ticks(void)
+{
+    unsigned lo, hi;
+
+    __asm__ __volatile__("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((unsigned long long)hi << 32) | lo;
+}
+#define LAT_UNIT "cycles"
+#else
+#include <time.h>
+static inline unsigned long long lat_ticks(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+#define LAT_UNIT "ns"
+#endif
+
+/* Measure the median cost of a back-to-back pair of lat_ticks calls */
+unsigned long long lat_overhead(void);
+
+/* Empty a histogram */
+void lat_reset(lat_hist_t *h);
+
+/* Add one sample of t ticks */
+void lat_record(lat_hist_t *h, unsigned long long t);
+
+/* Compute the percentiles of a histogram */
+void lat_summarize(lat_hist_t *h, lat_summary_t *s);
+
+#endif /* __LATENCY_H_ */
@@ -0,0 +1,145 @@
+/*
+ * loadbench.c - compare how long it takes to load trace files with the
+ *     mmap parser (read_trace) and with stdio (read_trace_stdio)
+ *
+ * Usage: loadbench [-n <reps>] [-s <ops>] <tracefile>...
+ *     -n <reps>  Average each measurement over <reps> loads (default 5).
+ *     -s <ops>   Also generate and load a synthetic trace of <ops> requests.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "trace.h"
+#include "ftimer.h"
+
+int verbose = 0; /* read by trace.c */
+
+/* The loader being timed and the file it loads */
+typedef struct {
+    trace_t *(*load)(char *tracedir, char *filename);
+    char *path;
+} load_t;
+
+static void load_once(void *argp);
+static char *write_synthetic(int num_ops);
+static void usage(void);
+
+int main(int argc, char **argv)
+{
+    int c, i, reps = 5, synth_ops = 0;
+    char *synth = NULL;
+    load_t fast, slow;
+    double tfast, tslow;
+    trace_t *trace;
+
+    while ((c = getopt(argc, argv, "n:s:h")) != EOF) {
+	switch (c) {
+	case 'n':
+	    reps = atoi(optarg);
+	    break;
+	case 's':
+	    synth_ops = atoi(optarg);
+	    break;
+	default:
+	    usage();
+	    exit(c != 'h');
+	}
+    }
+    if (optind == argc && synth_ops == 0) {
+	usage();
+	exit(1);
+    }
+    if (synth_ops > 0)
+	synth = write_synthetic(synth_ops);
+
+    printf("%-30s%10s%12s%12s%9s\n", 
+	   "trace", "ops", "stdio ms", "mmap ms", "speedup");
+    for (i = optind; i <= argc; i++) {
+	char *path = (i < argc) ? argv[i] : synth;
+	if (path == NULL)
+	    break;
+	trace = read_trace("", path);
+	slow.load = read_trace_stdio;
+	slow.path = fast.path = path;
+	fast.load = read_trace;
+	tfast = ftimer_gettod(load_once, &fast, reps);
+	if (is_binary_trace(path)) { /* stdio can't read these */
+	    printf("%-30s%10d%12s%12.3f%9s\n", 
+		   strrchr(path, '/') ? strrchr(path, '/') + 1 : path,
+		   trace->num_ops, "-", tfast*1e3, "-");
+	}
+	else {
+	    tslow = ftimer_gettod(load_once, &slow, reps);
+	    printf("%-30s%10d%12.3f%12.3f%8.1fx\n", 
+		   strrchr(path, '/') ? strrchr(path, '/') + 1 : path,
+		   trace->num_ops, tslow*1e3, tfast*1e3, tslow/tfast);
+	}
+	free_trace(trace);
+    }
+
+    if (synth != NULL)
+	unlink(synth);
+    exit(0);
+}
+
+/*
+ * load_once - load and free one trace; timed by ftimer_gettod
+ */
+static void load_once(void *argp)
+{
+    load_t *l = (load_t *)argp;
+
+    free_trace(l->load("", l->path));
+}
+
+/*
+ * write_synthetic - write a random trace of about num_ops requests 
+ *     (mallocs of up to 4 KB and matching frees) to a temporary file 
+ *     and return its name
+ */
+static char *write_synthetic(int num_ops)
+{
+    static char path[] = "/tmp/loadbench-XXXXXX";
+    FILE *fp;
+    int *live, nlive = 0, num_ids = 0, op, j, fd;
+    int nallocs = num_ops / 2;
+
+    if ((fd = mkstemp(path)) < 0 || (fp = fdopen(fd, "w")) == NULL) {
+	perror("loadbench: can't create synthetic trace");
+	exit(1);
+    }
+    if ((live = (int *)malloc(nallocs * sizeof(int))) == NULL) {
+	perror("loadbench: malloc");
+	exit(1);
+    }
+
+    srand(1);
+    fprintf(fp, "0\n%d\n%d\n1\n", nallocs, 2*nallocs);
+    for (op = 0; op < 2*nallocs; op++) {
+	if (num_ids < nallocs && (nlive == 0 || rand() % 2)) {
+	    fprintf(fp, "a %d %d\n", num_ids, 1 + rand() % 4096);
+	    live[nlive++] = num_ids++;
+	}
+	else {
+	    j = rand() % nlive;
+	    fprintf(fp, "f %d\n", live[j]);
+	    live[j] = live[--nlive];
+	}
+    }
+    fclose(fp);
+    free(live);
+    return path;
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: loadbench [-n <reps>] [-s <ops>] <tracefile>...\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-n <reps>  Average each measurement over <reps> loads.\n");
+    fprintf(stderr, "\t-s <ops>   Also load a synthetic trace of <ops> requests.\n");
+}
@@ -0,0 +1,342 @@
+/*
+ * mcapture.c - a preload library that records the malloc, calloc,
+ *     realloc and free calls of a program for capconv to turn into a
+ *     trace file
+ *
+ * Usage: LD_PRELOAD=./libmcapture.so MCAPTURE=<prefix> <program>...
+ *
+ * Each process writes <prefix>.<pid>.cap (prefix "mcapture" by default).
+ * Calls are logged as fixed-size records, buffered and written out
+ * BUFRECS at a time; block ids are assigned later by capconv, so the
+ * only work on the allocation path is copying one record under a lock.
+ * A block freed by free is logged before it is released and a block
+ * returned by malloc after it is obtained, so no other thread can log
+ * the reuse of an address ahead of its release. realloc does both at
+ * once, so it runs with the lock held.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dlfcn.h>
+#include <malloc.h>
+#include <pthread.h>
+
+#include "capture.h"
+
+#define MAXLINE    1024       /* max string size */
+#define BUFRECS    4096       /* records buffered between writes */
+#define BOOTSTRAP  (1<<16)    /* bytes handed out while finding libc */
+
+/* libc's allocator */
+static void *(*real_malloc)(size_t);
+static void *(*real_calloc)(size_t, size_t);
+static void *(*real_realloc)(void *, size_t);
+static void (*real_free)(void *);
+static void *(*real_memalign)(size_t, size_t);
+static int (*real_posix_memalign)(void **, size_t, size_t);
+static void *(*real_aligned_alloc)(size_t, size_t);
+
+/* The log */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static cap_rec_t buf[BUFRECS];
+static int nbuf = 0;
+static int fd = -1;
+
+/*
+ * dlsym itself may allocate, so until libc's allocator has been found
+ * requests are served from a static arena (and never freed)
+ */
+static int initializing = 0;
+static char bootstrap[BOOTSTRAP] __attribute__((aligned(16)));
+static size_t bootstrap_used = 0;
+
+/* function prototypes */
+static void init(void);
+static void open_log(void);
+static void log_call(int type, void *addr, void *old, size_t size);
+static void flush_log(void);
+static void *bootstrap_alloc(size_t size);
+static int is_bootstrap(void *p);
+static void before_fork(void);
+static void after_fork_parent(void);
+static void after_fork_child(void);
+static void finish(void) __attribute__((destructor));
+
+void *malloc(size_t size)
+{
+    void *p;
+
+    if (real_malloc == NULL) {
+	init();
+	if (real_malloc == NULL)
+	    return bootstrap_alloc(size);
+    }
+    p = real_malloc(size);
+    pthread_mutex_lock(&lock);
+    log_call(CAP_MALLOC, p, NULL, size);
+    pthread_mutex_unlock(&lock);
+    return p;
+}
+
+void *calloc(size_t n, size_t size)
+{
+    void *p;
+
+    /* n * size must not wrap around to a smaller block */
+    if (size != 0 && n > SIZE_MAX / size) {
+	errno = ENOMEM;
+	return NULL;
+    }
+    if (real_calloc == NULL) {
+	init();
+	if (real_calloc == NULL)
+	    return bootstrap_alloc(n * size); /* static, so already zero */
+    }
+    p = real_calloc(n, size);
+    pthread_mutex_lock(&lock);
+    log_call(CAP_MALLOC, p, NULL, n * size);
+    pthread_mutex_unlock(&lock);
+    return p;
+}
+
+void *realloc(void *old, size_t size)
+{
+    void *p;
+    size_t n;
+
+    if (real_realloc == NULL)
+	init();
+    if (real_realloc == NULL || is_bootstrap(old)) {
+	/* the old size isn't known, so copy all that might be in it */
+	if ((p = malloc(size)) != NULL && old != NULL) {
+	    n = bootstrap + BOOTSTRAP - (char *)old;
+	    memcpy(p, old, size < n ? size : n);
+	}
+	return p;
+    }
+    pthread_mutex_lock(&lock);
+    p = real_realloc(old, size);
+    log_call(CAP_REALLOC, p, old, size);
+    pthread_mutex_unlock(&lock);
+    return p;
+}
+
+void free(void *p)
+{
+    if (p == NULL || is_bootstrap(p))
+	return;
+    if (real_free == NULL)
+	init();
+    pthread_mutex_lock(&lock);
+    log_call(CAP_FREE, p, NULL, 0);
+    pthread_mutex_unlock(&lock);
+    real_free(p);
+}
+
+void *memalign(size_t align, size_t size)
+{
+    void *p;
+
+    if (real_memalign == NULL)
+	init();
+    p = real_memalign(align, size);
+    pthread_mutex_lock(&lock);
+    log_call(CAP_MALLOC, p, NULL, size);
+    pthread_mutex_unlock(&lock);
+    return p;
+}
+
+int posix_memalign(void **pp, size_t align, size_t size)
+{
+    int ret;
+
+    if (real_posix_memalign == NULL)
+	init();
+    if ((ret = real_posix_memalign(pp, align, size)) == 0) {
+	pthread_mutex_lock(&lock);
+	log_call(CAP_MALLOC, *pp, NULL, size);
+	pthread_mutex_unlock(&lock);
+    }
+    return ret;
+}
+
+void *aligned_alloc(size_t align, size_t size)
+{
+    void *p;
+
+    if (real_aligned_alloc == NULL)
+	init();
+    p = real_aligned_alloc(align, size);
+    pthread_mutex_lock(&lock);
+    log_call(CAP_MALLOC, p, NULL, size);
+    pthread_mutex_unlock(&lock);
+    return p;
+}
+
+/*
+ * The remaining routines are internal helper routines
+ */
+
+/*
+ * init - find libc's allocator and open the log. This runs before
+ *     main, or earlier if something allocates first, while the process
+ *     still has a single thread.
+ */
+static void init(void)
+{
+    if (initializing || real_malloc != NULL)
+	return;
+    initializing = 1;
+    real_malloc = dlsym(RTLD_NEXT, "malloc");
+    real_calloc = dlsym(RTLD_NEXT, "calloc");
+    real_realloc = dlsym(RTLD_NEXT, "realloc");
+    real_free = dlsym(RTLD_NEXT, "free");
+    real_memalign = dlsym(RTLD_NEXT, "memalign");
+    real_posix_memalign = dlsym(RTLD_NEXT, "posix_memalign");
+    real_aligned_alloc = dlsym(RTLD_NEXT, "aligned_alloc");
+    initializing = 0;
+    if (real_malloc == NULL || real_calloc == NULL || real_realloc == NULL ||
+	real_free == NULL) {
+	fprintf(stderr, "mcapture: could not find libc's malloc\n");
+	_exit(1);
+    }
+    open_log();
+    pthread_atfork(before_fork, after_fork_parent, after_fork_child);
+}
+
+static void start(void) __attribute__((constructor));
+static void start(void)
+{
+    init();
+}
+
+/*
+ * open_log - create this process's log file. If that fails the calls
+ *     just aren't recorded.
+ */
+static void open_log(void)
+{
+    char path[MAXLINE];
+    char *prefix = getenv("MCAPTURE");
+
+    snprintf(path, sizeof(path), "%s.%d%s", prefix ? prefix : "mcapture",
+	     (int)getpid(), CAP_EXT);
+    if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+	fprintf(stderr, "mcapture: could not create %s: %s\n",
+		path, strerror(errno));
+	return;
+    }
+    if (write(fd, CAP_MAGIC, 8) != 8) {
+	close(fd);
+	fd = -1;
+    }
+}
+
+/*
+ * log_call - add a record to the buffer, writing it out when it is
+ *     full. Called with the lock held.
+ */
+static void log_call(int type, void *addr, void *old, size_t size)
+{
+    cap_rec_t *r;
+
+    if (fd < 0)
+	return;
+    r = &buf[nbuf++];
+    r->addr = (uintptr_t)addr;
+    r->old = (uintptr_t)old;
+    r->size = size;
+    r->type = type;
+    r->pad = 0;
+    if (nbuf == BUFRECS)
+	flush_log();
+}
+
+/*
+ * flush_log - write out the buffered records. Called with the lock held.
+ */
+static void flush_log(void)
+{
+    char *p = (char *)buf;
+    size_t left = nbuf * sizeof(cap_rec_t);
+    ssize_t n;
+
+    while (left > 0) {
+	if ((n = write(fd, p, left)) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    close(fd); /* give up rather than log a partial stream */
+	    fd = -1;
+	    break;
+	}
+	p += n;
+	left -= n;
+    }
+    nbuf = 0;
+}
+
+/*
+ * bootstrap_alloc - hand out 16-byte aligned memory from the static arena
+ */
+static void *bootstrap_alloc(size_t size)
+{
+    void *p;
+
+    size = (size + 15) & ~(size_t)15;
+    if (size > BOOTSTRAP - bootstrap_used)
+	return NULL;
+    p = bootstrap + bootstrap_used;
+    bootstrap_used += size;
+    return p;
+}
+
+/*
+ * is_bootstrap - is p a block from the static arena?
+ */
+static int is_bootstrap(void *p)
+{
+    return (char *)p >= bootstrap && (char *)p < bootstrap + BOOTSTRAP;
+}
+
+/*
+ * The fork handlers keep the log consistent across fork: the child
+ * drops the records inherited from its parent, who will write them,
+ * and starts a log of its own
+ */
+static void before_fork(void)
+{
+    pthread_mutex_lock(&lock);
+}
+
+static void after_fork_parent(void)
+{
+    pthread_mutex_unlock(&lock);
+}
+
+static void after_fork_child(void)
+{
+    nbuf = 0;
+    if (fd >= 0)
+	close(fd);
+    open_log();
+    pthread_mutex_unlock(&lock);
+}
+
+/*
+ * finish - write out what is left of the log when the program exits
+ */
+static void finish(void)
+{
+    pthread_mutex_lock(&lock);
+    if (fd >= 0) {
+	flush_log();
+	close(fd);
+	fd = -1;
+    }
+    pthread_mutex_unlock(&lock);
+}
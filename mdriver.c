@@ -7,18 +7,36 @@
  * Copyright (c) 2002, R. Bryant and D. O'Hallaron, All rights reserved.
  * May not be used, modified, or copied without permission.
  */
+#define _GNU_SOURCE    /* for sched_setaffinity */
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <getopt.h>
 #include <errno.h>
 #include <string.h>
 #include <assert.h>
 #include <float.h>
+#include <math.h>
+#include <limits.h>
 #include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <sys/utsname.h>
 
 #include "mm.h"
 #include "memlib.h"
 #include "fsecs.h"
+#include "trace.h"
+#include "tracestream.h"
+#include "latency.h"
+#include "backend.h"
+#include "perfctr.h"
+#include "cacheflush.h"
+#include "mthread.h"
+#include "heapsnap.h"
+#include "baseline.h"
 #include "config.h"
 
 /**********************
@@ -27,8 +45,39 @@
 
 /* Misc */
 #define MAXLINE     1024 /* max string size */
-#define HDRLINES       4 /* number of header lines in a trace file */
 #define LINENUM(i) (i+5) /* cnvt trace request nums to linenums (origin 1) */
+#define NIL           -1 /* null index in the range set */
+
+/* 
+ * Gaps between payloads smaller than this are taken to be block
+ * overhead (headers, footers, padding) rather than free blocks when
+ * the fragmentation timeline is sampled
+ */
+#define FRAG_MIN_GAP  (2*ALIGNMENT)
+
+/* Output formats for the results (--format) */
+#define FORMAT_TEXT   0
+#define FORMAT_JSON   1
+#define FORMAT_CSV    2
+
+/* Long option values that have no short option */
+#define OPT_FORMAT    256
+#define OPT_ALLOC     257
+#define OPT_COLD      258
+#define OPT_SNAPSHOT  259
+#define OPT_SAVE_BASE 260
+#define OPT_COMPARE   261
+#define OPT_TOLERANCE 262
+#define OPT_LIST_CHECK 263
+
+/* Most heap snapshots per trace (--snapshot), and the "end" one */
+#define MAX_SNAPS     64
+#define SNAP_END      -1
+
+/* The compiler flags the driver was built with, from the Makefile */
+#ifndef BUILD_CFLAGS
+#define BUILD_CFLAGS  "unknown"
+#endif
 
 /* Returns true if p is ALIGNMENT-byte aligned */
 #define IS_ALIGNED(p)  ((((unsigned int)(p)) % ALIGNMENT) == 0)
@@ -38,29 +87,53 @@
  *****************************/
 
 /* Records the extent of each block's payload */
-typedef struct range_t {
+typedef struct {
     char *lo;              /* low payload address */
     char *hi;              /* high payload address */
-    struct range_t *next;  /* next list element */
+    int left, right;       /* children in the range set's treap (or NIL);
+			      with --list-check, right is the next range */
+    unsigned prio;         /* heap priority of this treap node */
 } range_t;
 
-/* Characterizes a single trace operation (allocator request) */
+/* 
+ * The extents of all currently allocated payloads, kept in a treap
+ * ordered by address so that overlaps, insertions and removals all
+ * take O(log n) expected time. Nodes live in the array v and refer
+ * to each other by index; unused nodes are chained through "left".
+ * With --list-check the set is instead an unordered list from root,
+ * linked through "right" and scanned in full, as the driver used to
+ * do, so that the two can be timed against each other.
+ */
+typedef struct {
+    range_t *v;            /* node storage */
+    int root;              /* root of the treap (or NIL) */
+    int free;              /* first unused node (or NIL) */
+    int max;               /* number of nodes allocated in v */
+} rangeset_t;
+
+/* 
+ * An entry in the table of live blocks used by streaming replay. The 
+ * table is an open-addressing hash table keyed by block id, so its size
+ * follows the number of live blocks rather than the number of ids.
+ * Each live block also gets a block slot, a small dense index into the
+ * blocks array that the timed replay uses in place of the id, so that
+ * the replay itself does no hashing. Slots are reused once freed.
+ */
 typedef struct {
-    enum {ALLOC, FREE, REALLOC} type; /* type of request */
-    int index;                        /* index for free() to use later */
-    int size;                         /* byte size of alloc/realloc request */
-} traceop_t;
+    unsigned long long key;  /* block id + 1, or 0 for an empty entry */
+    size_t slot;             /* its block slot */
+    unsigned long long size; /* payload size */
+} live_t;
 
-/* Holds the information for one trace file*/
 typedef struct {
-    int sugg_heapsize;   /* suggested heap size (unused) */
-    int num_ids;         /* number of alloc/realloc ids */
-    int num_ops;         /* number of distinct requests */
-    int weight;          /* weight for this trace (unused) */
-    traceop_t *ops;      /* array of requests */
-    char **blocks;       /* array of ptrs returned by malloc/realloc... */
-    size_t *block_sizes; /* ... and a corresponding array of payload sizes */
-} trace_t;
+    live_t *v;               /* entries */
+    size_t mask;             /* number of entries - 1 (a power of 2) */
+    size_t n;                /* number of live blocks */
+    char **blocks;           /* the payload in each block slot */
+    size_t *spare;           /* block slots not in use... */
+    size_t nspare;           /* ... and how many there are */
+    size_t nslots;           /* block slots handed out so far */
+} livetab_t;
 
 /* 
  * Holds the params to the xxx_speed functions, which are timed by fcyc. 
@@ -69,7 +142,7 @@ typedef struct {
  */
 typedef struct {
     trace_t *trace;  
-    range_t *ranges;
+    rangeset_t *ranges;
 } speed_t;
 
 /* Summarizes the important stats for some malloc function on some trace */
@@ -78,18 +151,90 @@ typedef struct {
     double ops;      /* number of ops (malloc/free/realloc) in the trace */
     int valid;       /* was the trace processed correctly by the allocator? */
     double secs;     /* number of secs needed to run the trace */
+    double spread;   /* MAD of the timed runs as a fraction of secs, or -1 */
+    int runs;        /* the timed runs behind secs, or 0 if not known */
+    double cold_secs; /* secs with the caches flushed before each run (--cold) */
+    mt_result_t mt[MT_MAX_COUNTS]; /* replays on each -T thread count; 
+				      secs < 0 if one failed */
 
     /* defined only for the student malloc package */
     double util;     /* space utilization for this trace (always 0 for libc) */
+    double valid_secs; /* time taken by the correctness pass */
+    double heapsize; /* heap size in bytes at the end of the util pass */
+    mem_stats_t mem; /* memlib's counters for the util pass */
+    mm_stats_t pkg;  /* the package's own counters for it (-s)... */
+    int has_pkg;     /* ... if it keeps them */
+    lat_summary_t lat[3]; /* request latencies by type, if measured (-L) */
+    pc_counts_t pc;  /* hardware events per request, if counted (-c) */
 
     /* Note: secs and util are only defined if valid is true */
 } stats_t; 
 
+/* The free gaps between payloads at some point in a trace (-F) */
+typedef struct {
+    size_t count;    /* number of gaps of at least FRAG_MIN_GAP bytes */
+    size_t bytes;    /* their total size */
+    size_t largest;  /* the largest one */
+} gaps_t;
+
+/* Describes the run as a whole, for the --format reports */
+typedef struct {
+    char *timer;             /* how fsecs measures time */
+    char *cflags;            /* how the driver was compiled... */
+    char *compiler;          /* ... and by what */
+    struct utsname uts;      /* host name, OS and machine */
+    long cpus;               /* CPUs online */
+    char os[MAXLINE];        /* OS name and release */
+    char date[32];           /* when the run finished, in UTC */
+} runinfo_t;
+
+/* A malloc package selected with -b, and how it did */
+typedef struct {
+    backend_t *backend;  /* its functions */
+    mem_heap_t *heap;    /* the simulated heap it runs on */
+    stats_t *stats;      /* its stats for each trace */
+    int errors;          /* errors found while evaluating it */
+    int numcorrect;      /* traces it processed correctly */
+    double p1, p2;       /* its perf index: the util and thru parts */
+} package_t;
+
+/* Evaluates one trace with some malloc package and fills in its stats */
+typedef void (*evalfn_t)(char *filename, int tracenum, stats_t *stats);
+
+/* What a -j worker sends back to the driver when its trace is done */
+typedef struct {
+    stats_t stats;   /* the stats for the worker's trace */
+    int errors;      /* errors the worker found on it */
+} result_t;
+
+/* A running -j worker */
+typedef struct {
+    pid_t pid;       /* the worker process, or 0 if the slot is free */
+    int fd;          /* read end of the pipe it reports on */
+    int tracenum;    /* the trace it is evaluating */
+} worker_t;
+
 /********************
  * Global variables
  *******************/
 int verbose = 0;        /* global flag for verbose output */
 static int errors = 0;  /* number of errs found when running student malloc */
+static backend_t *mm = backends; /* the mm package being evaluated (-b) */
+static int latency = 0; /* measure per-request latencies? (-L) */
+static int counters = 0; /* count hardware events? (-c) */
+static int cold = 0;    /* time each trace with cold caches too? (--cold) */
+static int pkg_stats = 0; /* report the packages' own counters? (-s) */
+static int list_check = 0; /* scan every payload for overlaps? (--list-check) */
+static int thread_counts[MT_MAX_COUNTS]; /* thread counts to replay on (-T) */
+static int num_thread_counts = 0;        /* ... and how many there are */
+static pthread_mutex_t mm_lock = PTHREAD_MUTEX_INITIALIZER; /* -T global lock */
+static mem_heap_t *mt_heap = NULL;       /* the heap the -T threads share */
+static unsigned long long lat_ovhd = 0; /* ticks to subtract from each */
+static int frag_interval = 0; /* sample fragmentation every this many ops */
+static int snap_ops[MAX_SNAPS]; /* snapshot the heap after these ops */
+static int num_snap_ops = 0;    /* ... and how many there are */
+static double tol_kops = TOL_KOPS; /* --compare tolerances (--tolerance) */
+static double tol_util = TOL_UTIL;
 char msg[MAXLINE];      /* for whenever we need to compose an error message */
 
 /* Directory where default tracefiles are found */
@@ -105,32 +250,105 @@ static char *default_tracefiles[] = {
  * Function prototypes 
  *********************/
 
-/* these functions manipulate range lists */
-static int add_range(range_t **ranges, char *lo, int size, 
+/* these functions manipulate range sets */
+static int add_range(rangeset_t *ranges, char *lo, int size, 
 		     int tracenum, int opnum);
-static void remove_range(range_t **ranges, char *lo);
-static void clear_ranges(range_t **ranges);
-
-/* These functions read, allocate, and free storage for traces */
-static trace_t *read_trace(char *tracedir, char *filename);
-static void free_trace(trace_t *trace);
+static void remove_range(rangeset_t *ranges, char *lo);
+static void clear_ranges(rangeset_t *ranges);
+static void split_ranges(range_t *v, int t, char *lo, int *left, int *right);
+static int merge_ranges(range_t *v, int left, int right);
+static void find_gaps(range_t *v, int t, char **next, gaps_t *gaps);
+static void add_gap(gaps_t *gaps, size_t size);
 
 /* Routines for evaluating the correctness and speed of libc malloc */
+static void eval_libc_trace(char *filename, int tracenum, stats_t *stats);
+static void eval_mm_trace(char *filename, int tracenum, stats_t *stats);
+static void eval_mm_trace_stream(char *filename, int tracenum, 
+				 stats_t *stats);
+static void run_traces(evalfn_t eval, char **tracefiles, int n, 
+		       stats_t *stats, int jobs, int pin);
+static void start_worker(evalfn_t eval, char *filename, int tracenum, 
+			 worker_t *w, int cpu);
+static void finish_worker(worker_t *w, char *filename, int status, 
+			  stats_t *stats);
+
 static int eval_libc_valid(trace_t *trace, int tracenum);
 static void eval_libc_speed(void *ptr);
 
 /* Routines for evaluating correctnes, space utilization, and speed 
    of the student's malloc package in mm.c */
-static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges);
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges);
+static int eval_mm_valid(trace_t *trace, int tracenum, rangeset_t *ranges);
+static double eval_mm_util(trace_t *trace, int tracenum, rangeset_t *ranges,
+			   FILE *frag, mm_stats_t *peak, FILE *snap);
+static void sample_frag(FILE *frag, int opnum, rangeset_t *ranges, 
+			int total_size);
 static void eval_mm_speed(void *ptr);
+static void eval_threads(trace_t *trace, mt_alloc_t *alloc, stats_t *stats);
+static int locked_init(void);
+static void locked_attach(void);
+static void *locked_malloc(size_t size);
+static void locked_free(void *ptr);
+static void *locked_realloc(void *ptr, size_t size);
+static void eval_mm_latency(trace_t *trace, lat_hist_t *hists);
+static int eval_mm_stream(char *tracedir, char *filename, int tracenum, 
+			  stats_t *stats);
+
+/* these functions manipulate the live block table of eval_mm_stream */
+static live_t *live_find(livetab_t *tab, unsigned long long id);
+static size_t live_insert(livetab_t *tab, unsigned long long id, 
+			  unsigned long long size);
+static void live_remove(livetab_t *tab, live_t *l);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats);
+static void printheap(int n, stats_t *stats);
+static void printlatency(int n, stats_t *stats);
+static void printcounters(int n, stats_t *stats);
+static void printcold(int n, stats_t *stats);
+static void printthreads(int n, stats_t *stats);
+static void printpkgstats(int n, stats_t *stats);
+static char *size_label(size_t bytes, char *buf);
+static void score_package(package_t *pkg, int n);
+static void printscore(package_t *pkg, int named);
+static void printcompare(int n, package_t *packages, int num_packages);
+static int printbaseline(char **tracefiles, int n, package_t *pkg, 
+			 baseline_t *bl);
+static int compare_row(char *label, double util, double bl_util, 
+		       double kops, double bl_kops, double relerr, 
+		       double bl_relerr);
+static void printbaselat(char **tracefiles, int n, package_t *pkg, 
+			 baseline_t *bl);
+static void save_baseline(char *path, char **tracefiles, int n, 
+			  package_t *packages, int num_packages);
+static char *trace_name(char *filename);
+static void printreport(FILE *fp, int format, char **tracefiles, int n, 
+			package_t *packages, int num_packages, 
+			stats_t *libc_stats);
+static void json_stats(FILE *fp, char *name, char **tracefiles, int n, 
+		       stats_t *stats, double perfindex);
+static void csv_stats(FILE *fp, char *name, char **tracefiles, int n, 
+		      stats_t *stats, double perfindex, runinfo_t *run);
+static void json_threads(FILE *fp, stats_t *stats);
+static void json_pkgstats(FILE *fp, mm_stats_t *st);
+static void put_string(FILE *fp, char *s, int format);
 static void usage(void);
 static void unix_error(char *msg);
-static void malloc_error(int tracenum, int opnum, char *msg);
+static void malloc_error(int tracenum, long opnum, char *msg);
 static void app_error(char *msg);
+static size_t parse_size(char *str);
+static int parse_threads(char *str);
+static int parse_snapshots(char *str);
+static int parse_tolerance(char *str);
+static void out_path(char *path, char *filename, char *suffix);
+static double wallclock(void);
+
+/* 
+ * The allocators -T replays traces with: libc malloc as it is, and the
+ * mm packages, which aren't thread-safe, one call at a time
+ */
+static mt_alloc_t libc_alloc = {NULL, NULL, malloc, free, realloc};
+static mt_alloc_t locked_mm = {locked_init, locked_attach, locked_malloc, 
+			       locked_free, locked_realloc};
 
 /**************
  * Main routine
@@ -138,27 +356,51 @@ static void app_error(char *msg);
 int main(int argc, char **argv)
 {
     int i;
-    char c;
+    int c;
     char **tracefiles = NULL;  /* null-terminated array of trace file names */
     int num_tracefiles = 0;    /* the number of traces in that array */
-    trace_t *trace = NULL;     /* stores a single trace file in memory */
-    range_t *ranges = NULL;    /* keeps track of block extents for one trace */
     stats_t *libc_stats = NULL;/* libc stats for each trace */
-    stats_t *mm_stats = NULL;  /* mm (i.e. student) stats for each trace */
-    speed_t speed_params;      /* input parameters to the xx_speed routines */ 
+    package_t *packages;       /* the mm packages to evaluate (-b)... */
+    int num_packages = 0;      /* ... and how many there are */
+    package_t *pkg;
+    char *backend_list = NULL; /* their names, separated by commas */
+    char **plugins = NULL;     /* shared objects with more (--alloc)... */
+    int num_plugins = 0;       /* ... and how many there are */
+    char *name;
 
     int team_check = 1;  /* If set, check team structure (reset by -a) */
     int run_libc = 0;    /* If set, run libc malloc (set by -l) */
     int autograder = 0;  /* If set, emit summary info for autograder (-g) */
+    size_t max_heap = MAX_HEAP; /* size of the heap reservation (-m) */
+    int prefault = 0;    /* If set, pre-fault heap pages as committed (-P) */
+    int hugepages = 0;   /* If set, back the heap with huge pages (-H) */
+    int stream = 0;      /* If set, stream traces from disk (-S) */
+    int jobs = 1;        /* Number of traces to evaluate at once (-j) */
+    int pin = 0;         /* If set, pin each -j worker to a CPU (-C) */
+    int heap_flags;      /* MEM_PREFAULT and/or MEM_HUGEPAGES */
+    int format = FORMAT_TEXT; /* Format of the results (--format) */
+    FILE *report = NULL; /* Where the --format results go */
+    char *save_path = NULL;  /* Where to save the results (--save-baseline) */
+    char *compare = NULL;    /* Baseline to compare them with (--compare)... */
+    baseline_t base;         /* ... as read from it */
+    int regressions = 0;     /* Results that fell short of it */
+    static struct option long_opts[] = {
+	{"format", required_argument, NULL, OPT_FORMAT},
+	{"alloc", required_argument, NULL, OPT_ALLOC},
+	{"cold", no_argument, NULL, OPT_COLD},
+	{"snapshot", required_argument, NULL, OPT_SNAPSHOT},
+	{"save-baseline", required_argument, NULL, OPT_SAVE_BASE},
+	{"compare", required_argument, NULL, OPT_COMPARE},
+	{"tolerance", required_argument, NULL, OPT_TOLERANCE},
+	{"list-check", no_argument, NULL, OPT_LIST_CHECK},
+	{NULL, 0, NULL, 0}
+    };
 
-    /* temporaries used to compute the performance index */
-    double secs, ops, util, avg_mm_util, avg_mm_throughput, p1, p2, perfindex;
-    int numcorrect;
-    
     /* 
      * Read and interpret the command line arguments 
      */
-    while ((c = getopt(argc, argv, "f:t:hvVgal")) != EOF) {
+    while ((c = getopt_long(argc, argv, "f:t:m:j:F:b:T:hvVgalPHSCLcs", 
+			    long_opts, NULL)) != EOF) {
         switch (c) {
 	case 'g': /* Generate summary info for the autograder */
 	    autograder = 1;
@@ -184,6 +426,96 @@ int main(int argc, char **argv)
         case 'l': /* Run libc malloc */
             run_libc = 1;
             break;
+        case 'b': /* Evaluate these mm packages */
+            backend_list = optarg;
+            break;
+        case 'm': /* Size of the simulated heap reservation */
+            if ((max_heap = parse_size(optarg)) == 0) {
+		usage();
+		exit(1);
+	    }
+            break;
+        case 'P': /* Pre-fault heap pages when they are committed */
+            prefault = 1;
+            break;
+        case 'H': /* Back the heap with transparent huge pages */
+            hugepages = 1;
+            break;
+        case 'S': /* Stream traces instead of loading them */
+            stream = 1;
+            break;
+        case 'j': /* Evaluate this many traces at once in worker processes */
+            if ((jobs = atoi(optarg)) < 1) {
+		usage();
+		exit(1);
+	    }
+            break;
+        case 'C': /* Pin each worker process to its own CPU */
+            pin = 1;
+            break;
+        case 'L': /* Measure the latency of each request */
+            latency = 1;
+            break;
+        case 'c': /* Count hardware events while replaying each trace */
+            counters = 1;
+            break;
+        case 's': /* Report the package's own counters for each trace */
+            pkg_stats = 1;
+            break;
+        case 'T': /* Replay each trace on this many threads at once */
+            if ((num_thread_counts = parse_threads(optarg)) == 0) {
+		usage();
+		exit(1);
+	    }
+            break;
+        case 'F': /* Write a fragmentation timeline for each trace */
+            if ((frag_interval = atoi(optarg)) < 1) {
+		usage();
+		exit(1);
+	    }
+            break;
+        case OPT_ALLOC: /* Evaluate the mm package in a shared object */
+	    plugins = realloc(plugins, (num_plugins+1)*sizeof(char *));
+	    if (plugins == NULL)
+		unix_error("ERROR: realloc failed in main");
+	    plugins[num_plugins++] = optarg;
+	    break;
+        case OPT_COLD: /* Time each trace with cold caches as well */
+	    cold = 1;
+	    break;
+        case OPT_SNAPSHOT: /* Dump the heap after these requests */
+	    if ((num_snap_ops = parse_snapshots(optarg)) == 0) {
+		usage();
+		exit(1);
+	    }
+	    break;
+        case OPT_SAVE_BASE: /* Save the results as a baseline */
+	    save_path = optarg;
+	    break;
+        case OPT_COMPARE: /* Compare the results with a baseline */
+	    compare = optarg;
+	    break;
+        case OPT_TOLERANCE: /* How far they may fall short of it */
+	    if (!parse_tolerance(optarg)) {
+		usage();
+		exit(1);
+	    }
+	    break;
+        case OPT_LIST_CHECK: /* Check payloads the old, quadratic way */
+	    list_check = 1;
+	    break;
+        case OPT_FORMAT: /* Report the results as JSON or CSV */
+	    if (!strcmp(optarg, "json"))
+		format = FORMAT_JSON;
+	    else if (!strcmp(optarg, "csv"))
+		format = FORMAT_CSV;
+	    else if (!strcmp(optarg, "text"))
+		format = FORMAT_TEXT;
+	    else {
+		usage();
+		exit(1);
+	    }
+	    break;
         case 'v': /* Print per-trace performance breakdown */
             verbose = 1;
             break;
@@ -199,6 +531,19 @@ int main(int argc, char **argv)
         }
     }
 	
+    /*
+     * With --format the report is the only thing written to stdout, so
+     * that it can be piped straight into other tools. Everything else
+     * the driver prints goes to stderr.
+     */
+    if (format != FORMAT_TEXT) {
+	fflush(stdout);
+	if ((report = fdopen(dup(STDOUT_FILENO), "w")) == NULL)
+	    unix_error("Could not duplicate stdout for --format");
+	if (dup2(STDERR_FILENO, STDOUT_FILENO) < 0)
+	    unix_error("Could not redirect stdout for --format");
+    }
+
     /* 
      * Check and print team info 
      */
@@ -233,6 +578,45 @@ int main(int argc, char **argv)
 	    printf("Member 3 :%s:%s\n", team.name3, team.id3);
     }
 
+    /*
+     * Look up the mm packages to evaluate: the ones named in the -b 
+     * list, in that order, or all of them if it is "all", then those
+     * loaded with --alloc. Without either, it is just mm.
+     */
+    if (backend_list == NULL && num_plugins == 0)
+	backend_list = "mm";
+    for (i = 1 + num_plugins, name = backend_list; name && *name; name++)
+	i += (*name == ',');
+    for (mm = backends; mm->name != NULL; mm++)
+	i++;
+    if ((packages = (package_t *)calloc(i, sizeof(package_t))) == NULL)
+	unix_error("packages calloc in main failed");
+    if (backend_list != NULL && !strcmp(backend_list, "all")) {
+	for (mm = backends; mm->name != NULL; mm++)
+	    packages[num_packages++].backend = mm;
+    }
+    else if (backend_list != NULL) {
+	if ((backend_list = strdup(backend_list)) == NULL)
+	    unix_error("strdup failed in main");
+	for (name = strtok(backend_list, ","); name != NULL; 
+	     name = strtok(NULL, ",")) {
+	    if ((mm = find_backend(name)) == NULL) {
+		printf("ERROR: No malloc package called \"%s\" (have", name);
+		for (mm = backends; mm->name != NULL; mm++)
+		    printf(" %s", mm->name);
+		printf(")\n");
+		exit(1);
+	    }
+	    packages[num_packages++].backend = mm;
+	}
+    }
+    for (i = 0; i < num_plugins; i++)
+	packages[num_packages++].backend = load_backend(plugins[i]);
+    if (num_packages == 0) {
+	usage();
+	exit(1);
+    }
+
     /* 
      * If no -f command line arg, then use the entire set of tracefiles 
      * defined in default_traces[]
@@ -245,10 +629,76 @@ int main(int argc, char **argv)
 
     /* Initialize the timing package */
     init_fsecs();
+    if (latency && stream) {
+	printf("Note: -L is ignored when streaming traces (-S)\n");
+	latency = 0;
+    }
+    if (frag_interval && stream) {
+	printf("Note: -F is ignored when streaming traces (-S)\n");
+	frag_interval = 0;
+    }
+    if (frag_interval && list_check) {
+	printf("Note: -F is ignored with --list-check, which keeps the "
+	       "payloads unordered\n");
+	frag_interval = 0;
+    }
+    if (num_snap_ops && stream) {
+	printf("Note: --snapshot is ignored when streaming traces (-S)\n");
+	num_snap_ops = 0;
+    }
+    if (counters && stream) {
+	printf("Note: -c is ignored when streaming traces (-S)\n");
+	counters = 0;
+    }
+    if (counters && pc_open(msg, MAXLINE) == 0) {
+	printf("Note: -c is ignored, no hardware counters (%s)\n", msg);
+	counters = 0;
+    }
+    if (cold && stream) {
+	printf("Note: --cold is ignored when streaming traces (-S)\n");
+	cold = 0;
+    }
+    if (num_thread_counts && stream) {
+	printf("Note: -T is ignored when streaming traces (-S)\n");
+	num_thread_counts = 0;
+    }
+    if (num_thread_counts && jobs > 1) {
+	printf("Note: -j is ignored with -T, so that the threads have the "
+	       "CPUs to themselves\n");
+	jobs = 1;
+    }
+    if (compare != NULL) {
+	if (!bl_load(compare, &base, msg))
+	    app_error(msg);
+	if (strcmp(base.timer, fsecs_method()))
+	    printf("Note: %s was timed with %s, this run with %s\n", compare,
+		   base.timer, fsecs_method());
+    }
+    if (save_path != NULL) {
+	/* find out now, not after every trace has run */
+	for (i = 0; i < num_packages; i++)
+	    if (!bl_checkname(packages[i].backend->name, msg))
+		app_error(msg);
+	for (i = 0; i < num_tracefiles; i++)
+	    if (!bl_checkname(trace_name(tracefiles[i]), msg))
+		app_error(msg);
+    }
+    if (cold && verbose)
+	printf("Flushing %lu KB of cache before each cold run.\n",
+	       (unsigned long)(flush_bytes() >> 10));
+    if (latency) {
+	lat_ovhd = lat_overhead();
+	if (verbose > 1)
+	    printf("Timer overhead: %llu %s\n", lat_ovhd, LAT_UNIT);
+    }
 
     /*
      * Optionally run and evaluate the libc malloc package 
      */
+    if (run_libc && stream) {
+	printf("Note: -l is ignored when streaming traces (-S)\n");
+	run_libc = 0;
+    }
     if (run_libc) {
 	if (verbose > 1)
 	    printf("\nTesting libc malloc\n");
@@ -259,138 +709,457 @@ int main(int argc, char **argv)
 	    unix_error("libc_stats calloc in main failed");
 	
 	/* Evaluate the libc malloc package using the K-best scheme */
-	for (i=0; i < num_tracefiles; i++) {
-	    trace = read_trace(tracedir, tracefiles[i]);
-	    libc_stats[i].ops = trace->num_ops;
-	    if (verbose > 1)
-		printf("Checking libc malloc for correctness, ");
-	    libc_stats[i].valid = eval_libc_valid(trace, i);
-	    if (libc_stats[i].valid) {
-		speed_params.trace = trace;
-		if (verbose > 1)
-		    printf("and performance.\n");
-		libc_stats[i].secs = fsecs(eval_libc_speed, &speed_params);
-	    }
-	    free_trace(trace);
-	}
+	run_traces(eval_libc_trace, tracefiles, num_tracefiles, libc_stats, 
+		   jobs, pin);
 
 	/* Display the libc results in a compact table */
 	if (verbose) {
 	    printf("\nResults for libc malloc:\n");
 	    printresults(num_tracefiles, libc_stats);
 	}
+	if (num_thread_counts) {
+	    printf("\nThread scaling for libc malloc:\n");
+	    printthreads(num_tracefiles, libc_stats);
+	}
     }
 
     /*
-     * Always run and evaluate the student's mm package
+     * Run and evaluate the mm packages (just the student's unless -b
+     * says otherwise), one after another and each on a heap of its own
      */
-    if (verbose > 1)
-	printf("\nTesting mm malloc\n");
-
-    /* Allocate the mm stats array, with one stats_t struct per tracefile */
-    mm_stats = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
-    if (mm_stats == NULL)
-	unix_error("mm_stats calloc in main failed");
-    
-    /* Initialize the simulated memory system in memlib.c */
-    mem_init(); 
-
-    /* Evaluate student's mm malloc package using the K-best scheme */
-    for (i=0; i < num_tracefiles; i++) {
-	trace = read_trace(tracedir, tracefiles[i]);
-	mm_stats[i].ops = trace->num_ops;
+    heap_flags = (prefault ? MEM_PREFAULT : 0) | (hugepages ? MEM_HUGEPAGES : 0);
+    for (i = 0; i < num_packages; i++) {
+	pkg = &packages[i];
+	mm = pkg->backend;
 	if (verbose > 1)
-	    printf("Checking mm_malloc for correctness, ");
-	mm_stats[i].valid = eval_mm_valid(trace, i, &ranges);
-	if (mm_stats[i].valid) {
-	    if (verbose > 1)
-		printf("efficiency, ");
-	    mm_stats[i].util = eval_mm_util(trace, i, &ranges);
-	    speed_params.trace = trace;
-	    speed_params.ranges = ranges;
-	    if (verbose > 1)
-		printf("and performance.\n");
-	    mm_stats[i].secs = fsecs(eval_mm_speed, &speed_params);
+	    printf("\nTesting %s malloc\n", mm->name);
+
+	/* Allocate the stats array, with one stats_t struct per tracefile */
+	pkg->stats = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
+	if (pkg->stats == NULL)
+	    unix_error("mm stats calloc in main failed");
+
+	/* Give the package a simulated memory system of its own */
+	if ((pkg->heap = mem_heap_create(max_heap, heap_flags)) == NULL)
+	    unix_error("mem_heap_create failed in main");
+	mem_use_heap(pkg->heap);
+	if (i == 0 && (verbose || hugepages))
+	    printf("Heap backing: %s\n", mem_backing());
+	if (i == 0 && verbose > 1)
+	    printf("Reserved %lu bytes for the heap%s\n", 
+		   (unsigned long)mem_maxheap(), 
+		   prefault ? " (pre-faulted)" : "");
+
+	if (num_snap_ops && mm->walk == NULL)
+	    printf("Note: --snapshot is ignored for %s malloc, which has no "
+		   "mm_walk\n", mm->name);
+
+	/* Evaluate the package using the K-best scheme */
+	errors = 0;
+	run_traces(stream ? eval_mm_trace_stream : eval_mm_trace, tracefiles,
+		   num_tracefiles, pkg->stats, jobs, pin);
+	pkg->errors = errors;
+
+	/* Display its results in a compact table */
+	if (verbose) {
+	    printf("\nResults for %s malloc:\n", mm->name);
+	    printresults(num_tracefiles, pkg->stats);
+	    if (hugepages && jobs == 1)
+		printf("Heap bytes in huge pages: %lu\n", 
+		       (unsigned long)mem_hugepage_bytes());
+	    printf("\nHeap footprint for %s malloc:\n", mm->name);
+	    printheap(num_tracefiles, pkg->stats);
+	    printf("\n");
 	}
-	free_trace(trace);
-    }
-
-    /* Display the mm results in a compact table */
-    if (verbose) {
-	printf("\nResults for mm malloc:\n");
-	printresults(num_tracefiles, mm_stats);
-	printf("\n");
+	if (latency) {
+	    printf("Request latencies for %s malloc (%s):\n", mm->name, 
+		   LAT_UNIT);
+	    printlatency(num_tracefiles, pkg->stats);
+	    printf("\n");
+	}
+	if (counters) {
+	    printf("Hardware events per request for %s malloc:\n", mm->name);
+	    printcounters(num_tracefiles, pkg->stats);
+	    printf("\n");
+	}
+	if (cold) {
+	    printf("Cold and warm cache throughput for %s malloc:\n", 
+		   mm->name);
+	    printcold(num_tracefiles, pkg->stats);
+	    printf("\n");
+	}
+	for (c = 0; pkg_stats && c < num_tracefiles; c++)
+	    if (pkg->stats[c].has_pkg)
+		break;
+	if (pkg_stats && c == num_tracefiles)
+	    printf("Note: -s is ignored for %s malloc, which has no "
+		   "mm_stats or has its counters compiled out\n\n", mm->name);
+	else if (pkg_stats) {
+	    printf("Allocator counters for %s malloc:\n", mm->name);
+	    printpkgstats(num_tracefiles, pkg->stats);
+	    printf("\n");
+	}
+	if (num_thread_counts) {
+	    printf("Thread scaling for %s malloc (behind a global lock):\n",
+		   mm->name);
+	    printthreads(num_tracefiles, pkg->stats);
+	    printf("\n");
+	}
+	score_package(pkg, num_tracefiles);
     }
 
     /* 
-     * Accumulate the aggregate statistics for the student's mm package 
+     * Print the performance index of each package, next to each other
+     * if there are several
      */
-    secs = 0;
-    ops = 0;
-    util = 0;
-    numcorrect = 0;
-    for (i=0; i < num_tracefiles; i++) {
-	secs += mm_stats[i].secs;
-	ops += mm_stats[i].ops;
-	util += mm_stats[i].util;
-	if (mm_stats[i].valid)
-	    numcorrect++;
-    }
-    avg_mm_util = util/num_tracefiles;
+    if (num_packages > 1)
+	printcompare(num_tracefiles, packages, num_packages);
+    for (i = 0; i < num_packages; i++)
+	printscore(&packages[i], num_packages > 1);
 
-    /* 
-     * Compute and print the performance index 
+    /*
+     * Compare the results with a baseline, and/or save them as one
      */
-    if (errors == 0) {
-	avg_mm_throughput = ops/secs;
-
-	p1 = UTIL_WEIGHT * avg_mm_util;
-	if (avg_mm_throughput > AVG_LIBC_THRUPUT) {
-	    p2 = (double)(1.0 - UTIL_WEIGHT);
-	} 
-	else {
-	    p2 = ((double) (1.0 - UTIL_WEIGHT)) * 
-		(avg_mm_throughput/AVG_LIBC_THRUPUT);
+    if (compare != NULL) {
+	for (i = 0; i < num_packages; i++) {
+	    printf("\nCompared with %s for %s malloc (tolerance %.1f%% "
+		   "Kops, %.1f util points):\n", compare, 
+		   packages[i].backend->name, tol_kops, tol_util);
+	    regressions += printbaseline(tracefiles, num_tracefiles, 
+					 &packages[i], &base);
+	    if (latency)
+		printbaselat(tracefiles, num_tracefiles, &packages[i], &base);
 	}
-	
-	perfindex = (p1 + p2)*100.0;
-	printf("Perf index = %.0f (util) + %.0f (thru) = %.0f/100\n",
-	       p1*100, 
-	       p2*100, 
-	       perfindex);
-	
+	if (regressions)
+	    printf("\n%d regression%s against %s\n", regressions, 
+		   regressions > 1 ? "s" : "", compare);
+	else
+	    printf("\nNo regressions against %s\n", compare);
     }
-    else { /* There were errors */
-	perfindex = 0.0;
-	printf("Terminated with %d errors\n", errors);
+    if (save_path != NULL) {
+	save_baseline(save_path, tracefiles, num_tracefiles, packages, 
+		      num_packages);
+	printf("Saved the results as a baseline in %s\n", save_path);
+    }
+
+    if (report != NULL) {
+	printreport(report, format, tracefiles, num_tracefiles, packages, 
+		    num_packages, libc_stats);
+	fclose(report);
     }
 
     if (autograder) {
-	printf("correct:%d\n", numcorrect);
-	printf("perfidx:%.0f\n", perfindex);
+	pkg = &packages[0];
+	printf("correct:%d\n", pkg->numcorrect);
+	printf("perfidx:%.0f\n", (pkg->p1 + pkg->p2)*100.0);
+    }
+
+    exit(regressions ? 2 : 0);
+}
+
+
+/*****************************************************************
+ * The following routines evaluate a malloc package on whole traces,
+ * either one after another in the driver's process or in parallel,
+ * with each trace in a forked worker of its own. mm.c and memlib.c
+ * keep their state in globals, so workers are processes, not threads.
+ ****************************************************************/
+
+/*
+ * eval_libc_trace - Check libc malloc on a trace and time it
+ */
+static void eval_libc_trace(char *filename, int tracenum, stats_t *stats)
+{
+    trace_t *trace;
+    speed_t speed_params;
+
+    trace = read_trace(tracedir, filename);
+    stats->ops = trace->num_ops;
+    if (verbose > 1)
+	printf("Checking libc malloc for correctness, ");
+    stats->valid = eval_libc_valid(trace, tracenum);
+    if (stats->valid) {
+	speed_params.trace = trace;
+	if (verbose > 1)
+	    printf("and performance.\n");
+	stats->secs = fsecs(eval_libc_speed, &speed_params);
+	stats->spread = fsecs_spread();
+	stats->runs = fsecs_runs();
+	if (num_thread_counts)
+	    eval_threads(trace, &libc_alloc, stats);
+    }
+    free_trace(trace);
+}
+
+/*
+ * eval_mm_trace - Check the mm package on a trace, then measure its
+ *     space utilization and time it
+ */
+static void eval_mm_trace(char *filename, int tracenum, stats_t *stats)
+{
+    static rangeset_t ranges = {NULL, NIL, NIL, 0}; /* reused across traces */
+    trace_t *trace;
+    speed_t speed_params;
+    lat_hist_t hists[3];
+    mm_stats_t peak;
+    FILE *frag = NULL, *snap = NULL;
+    char path[MAXLINE];
+    double start;
+    int i;
+
+    trace = read_trace(tracedir, filename);
+    stats->ops = trace->num_ops;
+    if (verbose > 1)
+	printf("Checking mm_malloc for correctness, ");
+    start = wallclock();
+    stats->valid = eval_mm_valid(trace, tracenum, &ranges);
+    stats->valid_secs = wallclock() - start;
+    if (verbose > 1)
+	printf("(%.6f secs) ", stats->valid_secs);
+    if (stats->valid) {
+	if (verbose > 1)
+	    printf("efficiency, ");
+	if (frag_interval) {
+	    out_path(path, filename, "frag.csv");
+	    if ((frag = fopen(path, "w")) == NULL)
+		unix_error("Could not open the fragmentation timeline");
+	}
+	if (num_snap_ops && mm->walk != NULL) {
+	    out_path(path, filename, "snap");
+	    if ((snap = snap_create(path)) == NULL)
+		unix_error("Could not create the heap snapshot file");
+	}
+	memset(&peak, 0, sizeof(peak));
+	stats->util = eval_mm_util(trace, tracenum, &ranges, frag, 
+				   pkg_stats && mm->stats ? &peak : NULL, snap);
+	if (frag != NULL)
+	    fclose(frag);
+	if (snap != NULL && fclose(snap) != 0)
+	    unix_error("Could not write the heap snapshot file");
+	stats->heapsize = mem_heapsize();
+	mem_get_stats(&stats->mem);
+	if (pkg_stats && mm->stats != NULL && mm->stats(&stats->pkg) == 0) {
+	    /* the counters for the whole pass, the free blocks at the peak */
+	    stats->has_pkg = 1;
+	    stats->pkg.free_bytes = peak.free_bytes;
+	    stats->pkg.free_blocks = peak.free_blocks;
+	    stats->pkg.largest_free = peak.largest_free;
+	    memcpy(stats->pkg.class_blocks, peak.class_blocks, 
+		   sizeof(peak.class_blocks));
+	}
+	speed_params.trace = trace;
+	speed_params.ranges = &ranges;
+	if (verbose > 1)
+	    printf("and performance.\n");
+	stats->secs = fsecs(eval_mm_speed, &speed_params);
+	stats->spread = fsecs_spread();
+	stats->runs = fsecs_runs();
+	if (cold) {
+	    set_fsecs_flush(1);
+	    stats->cold_secs = fsecs(eval_mm_speed, &speed_params);
+	    set_fsecs_flush(0);
+	}
+	if (latency) {
+	    eval_mm_latency(trace, hists);
+	    for (i = 0; i < 3; i++)
+		lat_summarize(&hists[i], &stats->lat[i]);
+	}
+	if (counters) {
+	    /* one more run, warmed up by the timed ones */
+	    pc_start();
+	    eval_mm_speed(&speed_params);
+	    pc_stop(&stats->pc);
+	    for (i = 0; i < PC_EVENTS; i++)
+		if (stats->pc.count[i] >= 0)
+		    stats->pc.count[i] /= trace->num_ops;
+	}
+	if (num_thread_counts)
+	    eval_threads(trace, &locked_mm, stats);
+    }
+    free_trace(trace);
+}
+
+/*
+ * eval_mm_trace_stream - Evaluate the mm package on a trace streamed 
+ *     from disk (-S)
+ */
+static void eval_mm_trace_stream(char *filename, int tracenum, 
+				 stats_t *stats)
+{
+    stats->valid = eval_mm_stream(tracedir, filename, tracenum, stats);
+}
+
+/*
+ * run_traces - Evaluate each of the n traces with eval, filling in 
+ *     stats[i]. With jobs > 1 every trace runs in its own worker process, 
+ *     at most jobs of them at a time, and sends its stats back over a 
+ *     pipe. If pin is set, each running worker gets a CPU to itself 
+ *     (as long as there are enough) so that their timings stay comparable.
+ */
+static void run_traces(evalfn_t eval, char **tracefiles, int n, 
+		       stats_t *stats, int jobs, int pin)
+{
+    worker_t *workers;
+    cpu_set_t allowed;
+    int *cpus = NULL, ncpus = 0;
+    int i, slot, next, running, status;
+    pid_t pid;
+
+    if (jobs == 1) {
+	for (i = 0; i < n; i++)
+	    eval(tracefiles[i], i, &stats[i]);
+	return;
+    }
+    if (jobs > n)
+	jobs = n;
+
+    /* The CPUs we may run on, handed out to worker slots in order */
+    if (pin) {
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0)
+	    unix_error("sched_getaffinity failed in run_traces");
+	if ((cpus = (int *)malloc(CPU_SETSIZE * sizeof(int))) == NULL)
+	    unix_error("malloc failed in run_traces");
+	for (i = 0; i < CPU_SETSIZE; i++)
+	    if (CPU_ISSET(i, &allowed))
+		cpus[ncpus++] = i;
+	if (jobs > ncpus)
+	    printf("Warning: %d workers share %d CPUs\n", jobs, ncpus);
+    }
+    if (verbose > 1)
+	printf("Running %d traces in %d workers%s\n", n, jobs, 
+	       pin ? ", pinned to CPUs" : "");
+
+    if ((workers = (worker_t *)calloc(jobs, sizeof(worker_t))) == NULL)
+	unix_error("calloc failed in run_traces");
+    next = 0;
+    running = 0;
+    while (next < n || running > 0) {
+	/* Start a worker on the next trace in every free slot */
+	for (slot = 0; slot < jobs && next < n; slot++) {
+	    if (workers[slot].pid != 0)
+		continue;
+	    start_worker(eval, tracefiles[next], next, &workers[slot], 
+			 pin ? cpus[slot % ncpus] : -1);
+	    next++;
+	    running++;
+	}
+
+	/* Wait for one of them to finish and collect its results */
+	if ((pid = wait(&status)) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    unix_error("wait failed in run_traces");
+	}
+	for (slot = 0; slot < jobs; slot++)
+	    if (workers[slot].pid == pid)
+		break;
+	if (slot == jobs)
+	    continue;
+	i = workers[slot].tracenum;
+	finish_worker(&workers[slot], tracefiles[i], status, &stats[i]);
+	running--;
+    }
+
+    free(workers);
+    free(cpus);
+}
+
+/*
+ * start_worker - Fork a worker that evaluates one trace with eval, 
+ *     pinned to the given CPU unless it is -1, and writes a result_t 
+ *     to a pipe before it exits
+ */
+static void start_worker(evalfn_t eval, char *filename, int tracenum, 
+			 worker_t *w, int cpu)
+{
+    int fds[2];
+    cpu_set_t mask;
+    result_t result;
+    pid_t pid;
+
+    if (pipe(fds) < 0)
+	unix_error("pipe failed in start_worker");
+    fflush(stdout); /* or the worker would print our buffered output too */
+    if ((pid = fork()) < 0)
+	unix_error("fork failed in start_worker");
+
+    if (pid == 0) {
+	close(fds[0]);
+	if (cpu >= 0) {
+	    CPU_ZERO(&mask);
+	    CPU_SET(cpu, &mask);
+	    if (sched_setaffinity(0, sizeof(mask), &mask) < 0)
+		unix_error("sched_setaffinity failed in start_worker");
+	}
+	memset(&result, 0, sizeof(result));
+	eval(filename, tracenum, &result.stats);
+	result.errors = errors;
+	if (write(fds[1], &result, sizeof(result)) != sizeof(result))
+	    unix_error("write failed in start_worker");
+	exit(0);
     }
 
-    exit(0);
+    close(fds[1]);
+    w->pid = pid;
+    w->fd = fds[0];
+    w->tracenum = tracenum;
+}
+
+/*
+ * finish_worker - Read the results of a worker that has exited with 
+ *     the given status into *stats and free its slot. A worker that 
+ *     died without reporting counts as an error on its trace.
+ */
+static void finish_worker(worker_t *w, char *filename, int status, 
+			  stats_t *stats)
+{
+    result_t result;
+    ssize_t n;
+
+    while ((n = read(w->fd, &result, sizeof(result))) < 0 && errno == EINTR)
+	;
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0 && 
+	n == sizeof(result)) {
+	*stats = result.stats;
+	errors += result.errors;
+    }
+    else {
+	if (WIFSIGNALED(status))
+	    printf("ERROR [trace %d]: worker for %s killed by signal %d\n", 
+		   w->tracenum, filename, WTERMSIG(status));
+	else
+	    printf("ERROR [trace %d]: worker for %s exited with status %d\n", 
+		   w->tracenum, filename, WEXITSTATUS(status));
+	memset(stats, 0, sizeof(*stats));
+	errors++;
+    }
+    close(w->fd);
+    w->pid = 0;
 }
 
 
 /*****************************************************************
- * The following routines manipulate the range list, which keeps 
+ * The following routines manipulate the range set, which keeps 
  * track of the extent of every allocated block payload. We use the 
- * range list to detect any overlapping allocated blocks.
+ * range set to detect any overlapping allocated blocks. The set is
+ * ordered by address, so a new block only has to be checked against
+ * its predecessor and successor.
  ****************************************************************/
 
 /*
  * add_range - As directed by request opnum in trace tracenum,
  *     we've just called the student's mm_malloc to allocate a block of 
  *     size bytes at addr lo. After checking the block for correctness,
- *     we create a range struct for this block and add it to the range list. 
+ *     we create a range struct for this block and add it to the range set. 
  */
-static int add_range(range_t **ranges, char *lo, int size, 
+static int add_range(rangeset_t *ranges, char *lo, int size, 
 		     int tracenum, int opnum)
 {
+    static unsigned seed = 2463534242U;
     char *hi = lo + size - 1;
-    range_t *p;
+    range_t *v = ranges->v;
+    range_t *p = NULL;
+    int t, left, right;
     char msg[MAXLINE];
 
     assert(size > 0);
@@ -412,168 +1181,180 @@ static int add_range(range_t **ranges, char *lo, int size,
         return 0;
     }
 
-    /* The payload must not overlap any other payloads */
-    for (p = *ranges;  p != NULL;  p = p->next) {
-        if ((lo >= p->lo && lo <= p-> hi) ||
-            (hi >= p->lo && hi <= p->hi)) {
-	    sprintf(msg, "Payload (%p:%p) overlaps another payload (%p:%p)\n",
-		    lo, hi, p->lo, p->hi);
-	    malloc_error(tracenum, opnum, msg);
-	    return 0;
-        }
+    /* 
+     * The payload must not overlap any other payloads. Since the set
+     * is free of overlaps, only the last payload starting at or below 
+     * lo and the first one starting above it can collide. With 
+     * --list-check, it is compared with every other payload instead.
+     */
+    if (list_check) {
+	for (t = ranges->root; t != NIL && p == NULL; t = v[t].right)
+	    if ((lo >= v[t].lo && lo <= v[t].hi) ||
+		(hi >= v[t].lo && hi <= v[t].hi))
+		p = &v[t];
+    }
+    else {
+	for (t = ranges->root; t != NIL; ) {
+	    if (v[t].lo <= lo) {
+		if (v[t].hi >= lo) 
+		    p = &v[t];
+		t = v[t].right;
+	    }
+	    else {
+		if (v[t].lo <= hi && (p == NULL || p->lo > lo))
+		    p = &v[t];
+		t = v[t].left;
+	    }
+	}
+    }
+    if (p != NULL) {
+	sprintf(msg, "Payload (%p:%p) overlaps another payload (%p:%p)\n",
+		lo, hi, p->lo, p->hi);
+	malloc_error(tracenum, opnum, msg);
+	return 0;
     }
 
     /* 
      * Everything looks OK, so remember the extent of this block 
-     * by creating a range struct and adding it the range list.
+     * by taking a free node and adding it to the range set.
      */
-    if ((p = (range_t *)malloc(sizeof(range_t))) == NULL)
-	unix_error("malloc error in add_range");
-    p->next = *ranges;
-    p->lo = lo;
-    p->hi = hi;
-    *ranges = p;
+    if (ranges->free == NIL) {
+	int max = ranges->max ? 2*ranges->max : 1024;
+	if ((v = (range_t *)realloc(ranges->v, max * sizeof(range_t))) == NULL)
+	    unix_error("realloc error in add_range");
+	for (t = ranges->max; t < max; t++)
+	    v[t].left = (t+1 < max) ? t+1 : NIL;
+	ranges->free = ranges->max;
+	ranges->v = v;
+	ranges->max = max;
+    }
+    t = ranges->free;
+    ranges->free = v[t].left;
+    seed ^= seed << 13; seed ^= seed >> 17; seed ^= seed << 5; /* xorshift */
+    v[t].lo = lo;
+    v[t].hi = hi;
+    v[t].left = v[t].right = NIL;
+    v[t].prio = seed;
+
+    if (list_check) {
+	v[t].right = ranges->root;
+	ranges->root = t;
+	return 1;
+    }
+    split_ranges(v, ranges->root, lo, &left, &right);
+    ranges->root = merge_ranges(v, merge_ranges(v, left, t), right);
     return 1;
 }
 
 /* 
  * remove_range - Free the range record of block whose payload starts at lo 
  */
-static void remove_range(range_t **ranges, char *lo)
+static void remove_range(rangeset_t *ranges, char *lo)
 {
-    range_t *p;
-    range_t **prevpp = ranges;
-    //    int size;
-
-    for (p = *ranges;  p != NULL; p = p->next) {
-        if (p->lo == lo) {
-	    *prevpp = p->next;
-	    //            size = p->hi - p->lo + 1;
-            free(p);
-            break;
-        }
-        prevpp = &(p->next);
+    range_t *v = ranges->v;
+    int left, mid, right, *prev;
+
+    if (list_check) {
+	for (prev = &ranges->root; *prev != NIL; prev = &v[*prev].right)
+	    if (v[*prev].lo == lo) {
+		mid = *prev;
+		*prev = v[mid].right;
+		v[mid].left = ranges->free;
+		ranges->free = mid;
+		return;
+	    }
+	return;
+    }
+
+    /* cut out the nodes starting at exactly lo (at most one) */
+    split_ranges(v, ranges->root, lo, &left, &right);
+    split_ranges(v, left, lo - 1, &left, &mid);
+    if (mid != NIL) {
+	v[mid].left = ranges->free;
+	ranges->free = mid;
     }
+    ranges->root = merge_ranges(v, left, right);
 }
 
 /*
  * clear_ranges - free all of the range records for a trace 
  */
-static void clear_ranges(range_t **ranges)
+static void clear_ranges(rangeset_t *ranges)
 {
-    range_t *p;
-    range_t *pnext;
+    int t;
 
-    for (p = *ranges;  p != NULL;  p = pnext) {
-        pnext = p->next;
-        free(p);
-    }
-    *ranges = NULL;
+    for (t = 0; t < ranges->max; t++)
+	ranges->v[t].left = (t+1 < ranges->max) ? t+1 : NIL;
+    ranges->free = ranges->max ? 0 : NIL;
+    ranges->root = NIL;
 }
 
-
-/**********************************************
- * The following routines manipulate tracefiles
- *********************************************/
-
 /*
- * read_trace - read a trace file and store it in memory
+ * split_ranges - split treap t into the ranges starting at or below lo
+ *     (*left) and those starting above it (*right)
  */
-static trace_t *read_trace(char *tracedir, char *filename)
+static void split_ranges(range_t *v, int t, char *lo, int *left, int *right)
 {
-    FILE *tracefile;
-    trace_t *trace;
-    char type[MAXLINE];
-    char path[MAXLINE];
-    unsigned index, size;
-    unsigned max_index = 0;
-    unsigned op_index;
-
-    if (verbose > 1)
-	printf("Reading tracefile: %s\n", filename);
+    if (t == NIL)
+	*left = *right = NIL;
+    else if (v[t].lo <= lo) {
+	split_ranges(v, v[t].right, lo, &v[t].right, right);
+	*left = t;
+    }
+    else {
+	split_ranges(v, v[t].left, lo, left, &v[t].left);
+	*right = t;
+    }
+}
 
-    /* Allocate the trace record */
-    if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
-	unix_error("malloc 1 failed in read_trance");
-	
-    /* Read the trace file header */
-    strcpy(path, tracedir);
-    strcat(path, filename);
-    if ((tracefile = fopen(path, "r")) == NULL) {
-	sprintf(msg, "Could not open %s in read_trace", path);
-	unix_error(msg);
-    }
-    fscanf(tracefile, "%d", &(trace->sugg_heapsize)); /* not used */
-    fscanf(tracefile, "%d", &(trace->num_ids));     
-    fscanf(tracefile, "%d", &(trace->num_ops));     
-    fscanf(tracefile, "%d", &(trace->weight));        /* not used */
-    
-    /* We'll store each request line in the trace in this array */
-    if ((trace->ops = 
-	 (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
-	unix_error("malloc 2 failed in read_trace");
-
-    /* We'll keep an array of pointers to the allocated blocks here... */
-    if ((trace->blocks = 
-	 (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
-	unix_error("malloc 3 failed in read_trace");
-
-    /* ... along with the corresponding byte sizes of each block */
-    if ((trace->block_sizes = 
-	 (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
-	unix_error("malloc 4 failed in read_trace");
-    
-    /* read every request line in the trace file */
-    index = 0;
-    op_index = 0;
-    while (fscanf(tracefile, "%s", type) != EOF) {
-	switch(type[0]) {
-	case 'a':
-	    fscanf(tracefile, "%u %u", &index, &size);
-	    trace->ops[op_index].type = ALLOC;
-	    trace->ops[op_index].index = index;
-	    trace->ops[op_index].size = size;
-	    max_index = (index > max_index) ? index : max_index;
-	    break;
-	case 'r':
-	    fscanf(tracefile, "%u %u", &index, &size);
-	    trace->ops[op_index].type = REALLOC;
-	    trace->ops[op_index].index = index;
-	    trace->ops[op_index].size = size;
-	    max_index = (index > max_index) ? index : max_index;
-	    break;
-	case 'f':
-	    fscanf(tracefile, "%ud", &index);
-	    trace->ops[op_index].type = FREE;
-	    trace->ops[op_index].index = index;
-	    break;
-	default:
-	    printf("Bogus type character (%c) in tracefile %s\n", 
-		   type[0], path);
-	    exit(1);
-	}
-	op_index++;
-	
+/*
+ * merge_ranges - join treaps left and right, where every range in left 
+ *     starts below every range in right, and return the new root
+ */
+static int merge_ranges(range_t *v, int left, int right)
+{
+    if (left == NIL)
+	return right;
+    if (right == NIL)
+	return left;
+    if (v[left].prio > v[right].prio) {
+	v[left].right = merge_ranges(v, v[left].right, right);
+	return left;
     }
-    fclose(tracefile);
-    assert(max_index == trace->num_ids - 1);
-    assert(trace->num_ops == op_index);
-    
-    return trace;
+    v[right].left = merge_ranges(v, left, v[right].left);
+    return right;
+}
+
+/*
+ * find_gaps - Visit the payloads in subtree t in address order, adding
+ *     the gap between *next and each payload to *gaps if it is at least
+ *     FRAG_MIN_GAP bytes, and leave *next just past the last payload
+ */
+static void find_gaps(range_t *v, int t, char **next, gaps_t *gaps)
+{
+    if (t == NIL)
+	return;
+    find_gaps(v, v[t].left, next, gaps);
+    add_gap(gaps, v[t].lo - *next);
+    *next = v[t].hi + 1;
+    find_gaps(v, v[t].right, next, gaps);
 }
 
 /*
- * free_trace - Free the trace record and the three arrays it points
- *              to, all of which were allocated in read_trace().
+ * add_gap - Count a gap of size bytes in *gaps if it is big enough to
+ *     be a free block
  */
-void free_trace(trace_t *trace)
+static void add_gap(gaps_t *gaps, size_t size)
 {
-    free(trace->ops);         /* free the three arrays... */
-    free(trace->blocks);      
-    free(trace->block_sizes);
-    free(trace);              /* and the trace record itself... */
+    if (size < FRAG_MIN_GAP)
+	return;
+    gaps->count++;
+    gaps->bytes += size;
+    if (size > gaps->largest)
+	gaps->largest = size;
 }
 
+
 /**********************************************************************
  * The following functions evaluate the correctness, space utilization,
  * and throughput of the libc and mm malloc packages.
@@ -582,7 +1363,7 @@ void free_trace(trace_t *trace)
 /*
  * eval_mm_valid - Check the mm malloc package for correctness
  */
-static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) 
+static int eval_mm_valid(trace_t *trace, int tracenum, rangeset_t *ranges) 
 {
     int i, j;
     int index;
@@ -597,7 +1378,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
     clear_ranges(ranges);
 
     /* Call the mm package's init function */
-    if (mm_init() < 0) {
+    if (mm->init() < 0) {
 	malloc_error(tracenum, 0, "mm_init failed.");
 	return 0;
     }
@@ -612,7 +1393,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
         case ALLOC: /* mm_malloc */
 
 	    /* Call the student's malloc */
-	    if ((p = mm_malloc(size)) == NULL) {
+	    if ((p = mm->malloc(size)) == NULL) {
 		malloc_error(tracenum, i, "mm_malloc failed.");
 		return 0;
 	    }
@@ -641,7 +1422,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    
 	    /* Call the student's realloc */
 	    oldp = trace->blocks[index];
-	    if ((newp = mm_realloc(oldp, size)) == NULL) {
+	    if ((newp = mm->realloc(oldp, size)) == NULL) {
 		malloc_error(tracenum, i, "mm_realloc failed.");
 		return 0;
 	    }
@@ -661,7 +1442,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    oldsize = trace->block_sizes[index];
 	    if (size < oldsize) oldsize = size;
 	    for (j = 0; j < oldsize; j++) {
-	      if (newp[j] != (index & 0xFF)) {
+	      if ((unsigned char)newp[j] != (index & 0xFF)) {
 		malloc_error(tracenum, i, "mm_realloc did not preserve the "
 			     "data from old block");
 		return 0;
@@ -679,7 +1460,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    /* Remove region from list and call student's free function */
 	    p = trace->blocks[index];
 	    remove_range(ranges, p);
-	    mm_free(p);
+	    mm->free(p);
 	    break;
 
 	default:
@@ -701,22 +1482,54 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
  *   package on the trace. Note that our implementation of mem_sbrk() 
  *   doesn't allow the students to decrement the brk pointer, so brk
  *   is always the high water mark of the heap. 
- *   
+ *
+ *   If frag isn't NULL, the payloads are also tracked in the range set
+ *   and a line of CSV describing the heap is written to frag every
+ *   frag_interval requests and after the last one.
+ *
+ *   If peak isn't NULL, the package's mm_stats are taken into it right
+ *   after mm_init and then whenever the live bytes have grown by 1/64
+ *   since the last time, so that its free blocks are described as of 
+ *   (nearly) their peak.
+ *
+ *   If snap isn't NULL, a snapshot of every block in the heap is
+ *   appended to it after each of the requests in snap_ops.
  */
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
+static double eval_mm_util(trace_t *trace, int tracenum, rangeset_t *ranges,
+			   FILE *frag, mm_stats_t *peak, FILE *snap)
 {   
-    int i;
+    int i, next = 0;
     int index;
     int size, newsize, oldsize;
     int max_total_size = 0;
     int total_size = 0;
+    int peak_size = 0;
     char *p;
     char *newp, *oldp;
 
-    /* initialize the heap and the mm malloc package */
+    /* 
+     * Initialize the heap and the mm malloc package. The heap's pages
+     * are released first so that its resident size afterwards reflects
+     * only this trace. 
+     */
+    mem_decommit(mem_heap_lo(), mem_maxheap());
     mem_reset_brk();
-    if (mm_init() < 0)
+    mem_reset_stats();
+    if (mm->init() < 0)
 	app_error("mm_init failed in eval_mm_util");
+    if (frag != NULL) {
+	clear_ranges(ranges);
+	fprintf(frag, "op,live_bytes,heap_bytes,util,free_blocks,free_bytes,"
+		"largest_free\n");
+    }
+    if (peak != NULL)
+	mm->stats(peak);
+    if (snap != NULL && snap_ops[0] == 0) {
+	if (snap_write(snap, 0, mem_heap_lo(), mem_heapsize(), 0, 
+		       mm->walk) < 0)
+	    unix_error("Could not write the heap snapshot");
+	next++;
+    }
 
     for (i = 0;  i < trace->num_ops;  i++) {
         switch (trace->ops[i].type) {
@@ -725,8 +1538,10 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    index = trace->ops[i].index;
 	    size = trace->ops[i].size;
 
-	    if ((p = mm_malloc(size)) == NULL) 
+	    if ((p = mm->malloc(size)) == NULL) 
 		app_error("mm_malloc failed in eval_mm_util");
+	    if (frag != NULL)
+		add_range(ranges, p, size, tracenum, i);
 	    
 	    /* Remember region and size */
 	    trace->blocks[index] = p;
@@ -747,8 +1562,12 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    oldsize = trace->block_sizes[index];
 
 	    oldp = trace->blocks[index];
-	    if ((newp = mm_realloc(oldp,newsize)) == NULL)
+	    if ((newp = mm->realloc(oldp,newsize)) == NULL)
 		app_error("mm_realloc failed in eval_mm_util");
+	    if (frag != NULL) {
+		remove_range(ranges, oldp);
+		add_range(ranges, newp, newsize, tracenum, i);
+	    }
 
 	    /* Remember region and size */
 	    trace->blocks[index] = newp;
@@ -768,7 +1587,9 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    size = trace->block_sizes[index];
 	    p = trace->blocks[index];
 	    
-	    mm_free(p);
+	    mm->free(p);
+	    if (frag != NULL)
+		remove_range(ranges, p);
 	    
 	    /* Keep track of current total size
 	     * of all allocated blocks */
@@ -780,11 +1601,50 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    app_error("Nonexistent request type in eval_mm_util");
 
         }
+
+	if (frag != NULL && ((i+1) % frag_interval == 0 || 
+			     i+1 == trace->num_ops))
+	    sample_frag(frag, i+1, ranges, total_size);
+	if (snap != NULL && next < num_snap_ops && 
+	    (snap_ops[next] == i+1 || 
+	     (snap_ops[next] == SNAP_END && i+1 == trace->num_ops))) {
+	    if (snap_write(snap, i+1, mem_heap_lo(), mem_heapsize(), 
+			   total_size, mm->walk) < 0)
+		unix_error("Could not write the heap snapshot");
+	    next++;
+	}
+	if (peak != NULL && total_size > peak_size + peak_size/64) {
+	    mm->stats(peak);
+	    peak_size = total_size;
+	}
     }
 
     return ((double)max_total_size / (double)mem_heapsize());
 }
 
+/*
+ * sample_frag - Write one line of the fragmentation timeline after 
+ *     request opnum: the live payload bytes, the heap size, their ratio,
+ *     and the number, total and largest size of the free gaps between
+ *     payloads (including the gaps at either end of the heap)
+ */
+static void sample_frag(FILE *frag, int opnum, rangeset_t *ranges, 
+			int total_size)
+{
+    gaps_t gaps = {0, 0, 0};
+    char *next = (char *)mem_heap_lo();
+    size_t heapsize = mem_heapsize();
+
+    find_gaps(ranges->v, ranges->root, &next, &gaps);
+    if (heapsize > 0)
+	add_gap(&gaps, (char *)mem_heap_hi() + 1 - next);
+    fprintf(frag, "%d,%d,%lu,%.4f,%lu,%lu,%lu\n", opnum, total_size, 
+	    (unsigned long)heapsize, 
+	    heapsize ? (double)total_size / heapsize : 0.0,
+	    (unsigned long)gaps.count, (unsigned long)gaps.bytes, 
+	    (unsigned long)gaps.largest);
+}
+
 
 /*
  * eval_mm_speed - This is the function that is used by fcyc()
@@ -798,7 +1658,7 @@ static void eval_mm_speed(void *ptr)
 
     /* Reset the heap and initialize the mm package */
     mem_reset_brk();
-    if (mm_init() < 0) 
+    if (mm->init() < 0) 
 	app_error("mm_init failed in eval_mm_speed");
 
     /* Interpret each trace request */
@@ -808,7 +1668,7 @@ static void eval_mm_speed(void *ptr)
         case ALLOC: /* mm_malloc */
             index = trace->ops[i].index;
             size = trace->ops[i].size;
-            if ((p = mm_malloc(size)) == NULL)
+            if ((p = mm->malloc(size)) == NULL)
 		app_error("mm_malloc error in eval_mm_speed");
             trace->blocks[index] = p;
             break;
@@ -817,7 +1677,7 @@ static void eval_mm_speed(void *ptr)
 	    index = trace->ops[i].index;
             newsize = trace->ops[i].size;
 	    oldp = trace->blocks[index];
-            if ((newp = mm_realloc(oldp,newsize)) == NULL)
+            if ((newp = mm->realloc(oldp,newsize)) == NULL)
 		app_error("mm_realloc error in eval_mm_speed");
             trace->blocks[index] = newp;
             break;
@@ -825,7 +1685,7 @@ static void eval_mm_speed(void *ptr)
         case FREE: /* mm_free */
             index = trace->ops[i].index;
             block = trace->blocks[index];
-            mm_free(block);
+            mm->free(block);
             break;
 
 	default:
@@ -834,22 +1694,309 @@ static void eval_mm_speed(void *ptr)
 }
 
 /*
- * eval_libc_valid - We run this function to make sure that the
- *    libc malloc can run to completion on the set of traces.
- *    We'll be conservative and terminate if any libc malloc call fails.
- *
+ * eval_mm_latency - Replay the trace like eval_mm_speed, but read the
+ *    timer around every request and record how long it took, less the
+ *    timer overhead, in hists[type]. This is a separate pass so that
+ *    timing each request doesn't slow down the throughput runs.
  */
-static int eval_libc_valid(trace_t *trace, int tracenum)
+static void eval_mm_latency(trace_t *trace, lat_hist_t *hists)
 {
-    int i, newsize;
-    char *p, *newp, *oldp;
+    int i, index;
+    char *p;
+    unsigned long long t0, t1;
 
-    for (i = 0;  i < trace->num_ops;  i++) {
-        switch (trace->ops[i].type) {
+    for (i = 0; i < 3; i++)
+	lat_reset(&hists[i]);
 
-        case ALLOC: /* malloc */
-	    if ((p = malloc(trace->ops[i].size)) == NULL) {
-		malloc_error(tracenum, i, "libc malloc failed");
+    /* Reset the heap and initialize the mm package */
+    mem_reset_brk();
+    if (mm->init() < 0) 
+	app_error("mm_init failed in eval_mm_latency");
+
+    /* Interpret each trace request */
+    for (i = 0;  i < trace->num_ops;  i++) {
+	index = trace->ops[i].index;
+        switch (trace->ops[i].type) {
+
+        case ALLOC: /* mm_malloc */
+	    t0 = lat_ticks();
+	    p = mm->malloc(trace->ops[i].size);
+	    t1 = lat_ticks();
+            if (p == NULL)
+		app_error("mm_malloc error in eval_mm_latency");
+            trace->blocks[index] = p;
+            break;
+
+	case REALLOC: /* mm_realloc */
+	    t0 = lat_ticks();
+	    p = mm->realloc(trace->blocks[index], trace->ops[i].size);
+	    t1 = lat_ticks();
+            if (p == NULL)
+		app_error("mm_realloc error in eval_mm_latency");
+            trace->blocks[index] = p;
+            break;
+
+        case FREE: /* mm_free */
+	    t0 = lat_ticks();
+            mm->free(trace->blocks[index]);
+	    t1 = lat_ticks();
+            break;
+
+	default:
+	    app_error("Nonexistent request type in eval_mm_latency");
+        }
+	t1 = (t1 - t0 > lat_ovhd) ? t1 - t0 - lat_ovhd : 0;
+	lat_record(&hists[trace->ops[i].type], t1);
+    }
+}
+
+/*
+ * eval_threads - Replay a copy of the trace on each of several threads
+ *    at once, for each thread count in the -T list. A count that fails
+ *    (usually because the copies didn't fit in the heap) gets secs < 0.
+ */
+static void eval_threads(trace_t *trace, mt_alloc_t *alloc, stats_t *stats)
+{
+    int i;
+
+    for (i = 0; i < num_thread_counts; i++) {
+	if (verbose > 1)
+	    printf("Replaying on %d threads\n", thread_counts[i]);
+	if (!mt_replay(trace, alloc, thread_counts[i], &stats->mt[i]))
+	    stats->mt[i].secs = -1;
+    }
+}
+
+/*
+ * locked_xxx - The global-lock adapter -T runs the mm packages behind.
+ *    The threads share the heap of the thread that reset it.
+ */
+static int locked_init(void)
+{
+    mem_reset_brk();
+    mt_heap = mem_current_heap();
+    return mm->init();
+}
+
+static void locked_attach(void)
+{
+    mem_use_heap(mt_heap);
+}
+
+static void *locked_malloc(size_t size)
+{
+    void *p;
+
+    pthread_mutex_lock(&mm_lock);
+    p = mm->malloc(size);
+    pthread_mutex_unlock(&mm_lock);
+    return p;
+}
+
+static void locked_free(void *ptr)
+{
+    pthread_mutex_lock(&mm_lock);
+    mm->free(ptr);
+    pthread_mutex_unlock(&mm_lock);
+}
+
+static void *locked_realloc(void *ptr, size_t size)
+{
+    void *p;
+
+    pthread_mutex_lock(&mm_lock);
+    p = mm->realloc(ptr, size);
+    pthread_mutex_unlock(&mm_lock);
+    return p;
+}
+
+/*
+ * eval_mm_stream - Replay a trace straight from disk, one chunk of 
+ *    requests at a time, so that traces of any length can be run. Only
+ *    the blocks that are currently allocated are remembered. A single
+ *    pass measures both space utilization and throughput; payloads are 
+ *    checked for alignment and for lying inside the heap, but not for 
+ *    overlaps or data preservation. Fills in *stats and returns whether
+ *    the trace ran correctly.
+ *
+ *    Each chunk is replayed in three steps, and only the second is 
+ *    timed: the requests are checked and their block ids turned into 
+ *    block slots, the allocator is called on them, and the payloads it
+ *    returned are checked.
+ */
+static int eval_mm_stream(char *tracedir, char *filename, int tracenum, 
+			  stats_t *stats)
+{
+    trace_stream_t *ts;
+    streamop_t *ops;
+    livetab_t live = {NULL, 0, 0, NULL, NULL, 0, 0};
+    live_t *l;
+    char *p, **blocks;
+    size_t *slots = NULL;    /* the block slot of each request in a chunk */
+    char **newp = NULL;      /* the payload each one returned */
+    int maxn = 0;
+    unsigned long long opnum = 0, total_size = 0, max_total_size = 0;
+    size_t max_live = 0;
+    double secs = 0, start;
+    int i, n, ok = 0;
+    char msg[MAXLINE];
+
+    if (verbose > 1)
+	printf("Streaming tracefile: %s\n", filename);
+    ts = open_trace_stream(tracedir, filename);
+    stats->ops = (double)trace_stream_num_ops(ts);
+
+    /* Start from an empty, released heap, like eval_mm_util */
+    mem_decommit(mem_heap_lo(), mem_maxheap());
+    mem_reset_brk();
+    mem_reset_stats();
+    if (mm->init() < 0) {
+	malloc_error(tracenum, 0, "mm_init failed.");
+	goto out;
+    }
+
+    while ((n = trace_stream_next(ts, &ops)) > 0) {
+	if (n > maxn) {
+	    maxn = n;
+	    slots = (size_t *)realloc(slots, maxn * sizeof(size_t));
+	    newp = (char **)realloc(newp, maxn * sizeof(char *));
+	    if (slots == NULL || newp == NULL)
+		unix_error("realloc failed in eval_mm_stream");
+	}
+
+	/* Check the requests and find their block slots */
+	for (i = 0; i < n; i++) {
+	    if (ops[i].type != FREE && ops[i].size > mem_maxheap()) {
+		sprintf(msg, "Request of %llu bytes is larger than the heap",
+			ops[i].size);
+		malloc_error(tracenum, opnum + i, msg);
+		goto out;
+	    }
+	    l = live_find(&live, ops[i].index);
+	    switch (ops[i].type) {
+
+	    case ALLOC:
+		if (l != NULL) /* id reused without a free */
+		    live_remove(&live, l);
+		slots[i] = live_insert(&live, ops[i].index, ops[i].size);
+		total_size += ops[i].size;
+		break;
+
+	    case REALLOC:
+		if (l == NULL) {
+		    malloc_error(tracenum, opnum + i, 
+				 "realloc of a block that isn't allocated");
+		    goto out;
+		}
+		slots[i] = l->slot;
+		total_size += ops[i].size - l->size;
+		l->size = ops[i].size;
+		break;
+
+	    case FREE:
+		if (l == NULL) {
+		    malloc_error(tracenum, opnum + i, 
+				 "free of a block that isn't allocated");
+		    goto out;
+		}
+		slots[i] = l->slot;
+		total_size -= l->size;
+		live_remove(&live, l);
+		break;
+
+	    default:
+		app_error("Nonexistent request type in eval_mm_stream");
+	    }
+	    if (total_size > max_total_size)
+		max_total_size = total_size;
+	    if (live.n > max_live)
+		max_live = live.n;
+	}
+
+	/* Replay them, timing only the allocator */
+	blocks = live.blocks;
+	start = wallclock();
+	for (i = 0; i < n; i++) {
+	    switch (ops[i].type) {
+	    case ALLOC:
+		p = mm->malloc(ops[i].size);
+		break;
+	    case REALLOC:
+		p = mm->realloc(blocks[slots[i]], ops[i].size);
+		break;
+	    default: /* FREE */
+		mm->free(blocks[slots[i]]);
+		newp[i] = NULL;
+		continue;
+	    }
+	    if (p == NULL)
+		break;
+	    blocks[slots[i]] = newp[i] = p;
+	}
+	secs += wallclock() - start;
+	if (i < n) {
+	    malloc_error(tracenum, opnum + i, ops[i].type == ALLOC ? 
+			 "mm_malloc failed." : "mm_realloc failed.");
+	    goto out;
+	}
+
+	/* Check the new payloads: aligned and inside the heap */
+	for (i = 0; i < n; i++) {
+	    if ((p = newp[i]) == NULL)
+		continue;
+	    if (!IS_ALIGNED(p) || (p < (char *)mem_heap_lo()) || 
+		(p + ops[i].size - 1 > (char *)mem_heap_hi())) {
+		sprintf(msg, "Payload (%p:%p) is misaligned or outside heap "
+			"(%p:%p)", p, p + ops[i].size - 1, 
+			mem_heap_lo(), mem_heap_hi());
+		malloc_error(tracenum, opnum + i, msg);
+		goto out;
+	    }
+	}
+	opnum += n;
+    }
+    ok = 1;
+
+    stats->secs = secs;
+    stats->spread = -1; /* one pass */
+    stats->runs = 1;
+    stats->util = mem_heapsize() ? 
+	(double)max_total_size / (double)mem_heapsize() : 0;
+    stats->heapsize = mem_heapsize();
+    mem_get_stats(&stats->mem);
+    if (pkg_stats && mm->stats != NULL)
+	stats->has_pkg = (mm->stats(&stats->pkg) == 0);
+    if (verbose > 1)
+	printf("Replayed %llu requests, at most %lu blocks live.\n", 
+	       opnum, (unsigned long)max_live);
+
+ out:
+    close_trace_stream(ts);
+    free(live.v);
+    free(live.blocks);
+    free(live.spare);
+    free(slots);
+    free(newp);
+    return ok;
+}
+
+/*
+ * eval_libc_valid - We run this function to make sure that the
+ *    libc malloc can run to completion on the set of traces.
+ *    We'll be conservative and terminate if any libc malloc call fails.
+ *
+ */
+static int eval_libc_valid(trace_t *trace, int tracenum)
+{
+    int i, newsize;
+    char *p, *newp, *oldp;
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+        switch (trace->ops[i].type) {
+
+        case ALLOC: /* malloc */
+	    if ((p = malloc(trace->ops[i].size)) == NULL) {
+		malloc_error(tracenum, i, "libc malloc failed");
 		unix_error("System message");
 	    }
 	    trace->blocks[trace->ops[i].index] = p;
@@ -934,52 +2081,813 @@ static void printresults(int n, stats_t *stats)
     double util = 0;
 
     /* Print the individual results for each trace */
-    printf("%5s%7s %5s%8s%10s%6s\n", 
-	   "trace", " valid", "util", "ops", "secs", "Kops");
+    printf("%5s%7s %5s%8s%10s%7s%6s\n", 
+	   "trace", " valid", "util", "ops", "secs", "spread", "Kops");
     for (i=0; i < n; i++) {
 	if (stats[i].valid) {
-	    printf("%2d%10s%5.0f%%%8.0f%10.6f%6.0f\n", 
+	    printf("%2d%10s%5.0f%%%8.0f%10.6f", 
 		   i,
 		   "yes",
 		   stats[i].util*100.0,
 		   stats[i].ops,
-		   stats[i].secs,
-		   (stats[i].ops/1e3)/stats[i].secs);
+		   stats[i].secs);
+	    if (stats[i].spread >= 0)
+		printf("%6.1f%%", stats[i].spread*100.0);
+	    else
+		printf("%7s", "-");
+	    printf("%6.0f\n", (stats[i].ops/1e3)/stats[i].secs);
 	    secs += stats[i].secs;
 	    ops += stats[i].ops;
 	    util += stats[i].util;
 	}
 	else {
-	    printf("%2d%10s%6s%8s%10s%6s\n", 
+	    printf("%2d%10s%6s%8s%10s%7s%6s\n", 
 		   i,
 		   "no",
 		   "-",
 		   "-",
 		   "-",
+		   "-",
 		   "-");
 	}
     }
 
     /* Print the aggregate results for the set of traces */
     if (errors == 0) {
-	printf("%12s%5.0f%%%8.0f%10.6f%6.0f\n", 
+	printf("%12s%5.0f%%%8.0f%10.6f%7s%6.0f\n", 
 	       "Total       ",
 	       (util/n)*100.0,
 	       ops, 
 	       secs,
+	       "",
 	       (ops/1e3)/secs);
     }
     else {
-	printf("%12s%6s%8s%10s%6s\n", 
+	printf("%12s%6s%8s%10s%7s%6s\n", 
 	       "Total       ",
 	       "-", 
 	       "-", 
 	       "-", 
+	       "",
 	       "-");
     }
 
 }
 
+/*
+ * printheap - prints how the mm package used the heap on each trace:
+ *     final heap and resident size, sbrk calls and their average and
+ *     largest increments, the peak brk, bytes decommitted and the
+ *     minor page faults taken during the util pass
+ */
+static void printheap(int n, stats_t *stats) 
+{
+    int i;
+    mem_stats_t *m;
+
+    printf("%5s%10s%10s%5s%8s%9s%9s%10s%10s%8s\n", "trace", "heap KB", 
+	   "rss KB", "rss", "sbrks", "avg incr", "max incr", "peak KB", 
+	   "decmt KB", "minflt");
+    for (i=0; i < n; i++) {
+	m = &stats[i].mem;
+	if (stats[i].valid && stats[i].heapsize > 0)
+	    printf("%2d%13.0f%10.0f%4.0f%%%8lu%9.0f%9lu%10.0f%10.0f%8ld\n", 
+		   i,
+		   stats[i].heapsize/1024,
+		   m->resident/1024.0,
+		   m->resident*100.0/stats[i].heapsize,
+		   (unsigned long)m->sbrk_calls,
+		   m->sbrk_calls ? (double)m->sbrk_bytes/m->sbrk_calls : 0.0,
+		   (unsigned long)m->sbrk_max,
+		   m->peak_brk/1024.0,
+		   m->decommit_bytes/1024.0,
+		   m->minor_faults);
+	else
+	    printf("%2d%13s%10s%5s%8s%9s%9s%10s%10s%8s\n", 
+		   i, "-", "-", "-", "-", "-", "-", "-", "-", "-");
+    }
+}
+
+/*
+ * printlatency - prints the latency percentiles of each request type
+ *     on each trace, after the timer overhead has been subtracted
+ */
+static void printlatency(int n, stats_t *stats) 
+{
+    static char *names[3] = {"malloc", "free", "realloc"};
+    lat_summary_t *l;
+    int i, t;
+
+    printf("%5s%8s%9s%8s%8s%8s%8s%10s\n", "trace", "request", "count", 
+	   "p50", "p90", "p99", "p99.9", "max");
+    for (i=0; i < n; i++) {
+	if (!stats[i].valid) {
+	    printf("%2d%11s%9s%8s%8s%8s%8s%10s\n", 
+		   i, "-", "-", "-", "-", "-", "-", "-");
+	    continue;
+	}
+	for (t = 0; t < 3; t++) {
+	    l = &stats[i].lat[t];
+	    if (l->n == 0)
+		continue;
+	    printf("%2d%11s%9llu%8llu%8llu%8llu%8llu%10llu\n", 
+		   i, names[t], l->n, l->p50, l->p90, l->p99, l->p999, 
+		   l->max);
+	}
+    }
+}
+
+/*
+ * printcounters - prints the hardware events counted per request on 
+ *     each trace, and the instructions per cycle
+ */
+static void printcounters(int n, stats_t *stats) 
+{
+    double *c;
+    int i, e;
+
+    printf("%5s", "trace");
+    for (e = 0; e < PC_EVENTS; e++)
+	printf("%10s", pc_name(e));
+    printf("%6s\n", "IPC");
+    for (i=0; i < n; i++) {
+	printf("%2d   ", i);
+	c = stats[i].pc.count;
+	for (e = 0; e < PC_EVENTS; e++) {
+	    if (stats[i].valid && c[e] >= 0)
+		printf("%10.2f", c[e]);
+	    else
+		printf("%10s", "-");
+	}
+	if (stats[i].valid && c[PC_CYCLES] > 0 && c[PC_INSTRUCTIONS] >= 0)
+	    printf("%6.2f\n", c[PC_INSTRUCTIONS] / c[PC_CYCLES]);
+	else
+	    printf("%6s\n", "-");
+    }
+}
+
+/*
+ * printcold - prints the throughput on each trace with warm caches 
+ *     (as timed for the perf index) and with cold ones (--cold)
+ */
+static void printcold(int n, stats_t *stats) 
+{
+    double warm, coldkops;
+    int i;
+
+    printf("%5s%10s%10s%10s\n", "trace", "warm Kops", "cold Kops", "cold/warm");
+    for (i=0; i < n; i++) {
+	if (!stats[i].valid || stats[i].secs <= 0 || stats[i].cold_secs <= 0) {
+	    printf("%2d   %10s%10s%10s\n", i, "-", "-", "-");
+	    continue;
+	}
+	warm = (stats[i].ops/1e3)/stats[i].secs;
+	coldkops = (stats[i].ops/1e3)/stats[i].cold_secs;
+	printf("%2d   %10.0f%10.0f%10.2f\n", i, warm, coldkops, coldkops/warm);
+    }
+}
+
+/*
+ * printthreads - prints the throughput of the -T replays: the total
+ *     over all threads, that of the average thread (timed by itself),
+ *     and the scaling efficiency, i.e. the total per thread relative to
+ *     that with the first thread count. The last rows are for all the
+ *     traces together.
+ */
+static void printthreads(int n, stats_t *stats) 
+{
+    double ops[MT_MAX_COUNTS], secs[MT_MAX_COUNTS], tsecs[MT_MAX_COUNTS];
+    double kops = 0, thread_kops = 0, base;
+    mt_result_t *r;
+    int i, k, ok;
+
+    printf("%5s%8s%12s%12s%8s\n", "trace", "threads", "Kops", 
+	   "Kops/thread", "scaling");
+    for (k = 0; k < num_thread_counts; k++)
+	ops[k] = secs[k] = tsecs[k] = 0;
+    for (i=0; i <= n; i++) {
+	base = -1;
+	for (k = 0; k < num_thread_counts; k++) {
+	    if (i < n) {
+		r = &stats[i].mt[k];
+		printf("%2d   %8d", i, thread_counts[k]);
+		if ((ok = stats[i].valid && r->secs > 0)) {
+		    ops[k] += stats[i].ops;
+		    secs[k] += r->secs;
+		    tsecs[k] += r->thread_secs;
+		    kops = (stats[i].ops*r->threads/1e3)/r->secs;
+		    thread_kops = (stats[i].ops/1e3)/r->thread_secs;
+		}
+	    }
+	    else {
+		printf("Total%8d", thread_counts[k]);
+		if ((ok = secs[k] > 0)) {
+		    kops = (ops[k]*thread_counts[k]/1e3)/secs[k];
+		    thread_kops = (ops[k]/1e3)/tsecs[k];
+		}
+	    }
+	    if (!ok) {
+		printf("%12s%12s%8s\n", "-", "-", "-");
+		continue;
+	    }
+	    if (base < 0)
+		base = kops/thread_counts[k];
+	    printf("%12.0f%12.0f%7.0f%%\n", kops, thread_kops, 
+		   kops/thread_counts[k]/base*100.0);
+	}
+    }
+}
+
+/*
+ * printpkgstats - prints what the package counted on each trace's util
+ *     pass (-s): per search, its free list steps; splits; coalesces by
+ *     which neighbours were free; sbrks; and realloc copies. Then its
+ *     free blocks when the live bytes peaked (at the end with -S), in 
+ *     total and by size class, up to the largest class any trace has 
+ *     blocks in.
+ */
+static void printpkgstats(int n, stats_t *stats) 
+{
+    mm_stats_t *st;
+    char buf[32];
+    int i, k, classes = 1;
+
+    printf("%5s%10s%8s%9s%9s%9s%9s%9s%7s%9s%10s\n", "trace", "searches",
+	   "steps", "splits", "coal:-", "coal:n", "coal:p", "coal:np", 
+	   "sbrks", "rcopies", "rcopy KB");
+    for (i=0; i < n; i++) {
+	st = &stats[i].pkg;
+	if (!stats[i].valid || !stats[i].has_pkg) {
+	    printf("%2d   %10s%8s%9s%9s%9s%9s%9s%7s%9s%10s\n", i, "-", "-",
+		   "-", "-", "-", "-", "-", "-", "-", "-");
+	    continue;
+	}
+	printf("%2d   %10lu%8.1f%9lu%9lu%9lu%9lu%9lu%7lu%9lu%10.0f\n", i,
+	       st->searches, 
+	       st->searches ? (double)st->search_steps / st->searches : 0.0,
+	       st->splits, st->coalesce[0], st->coalesce[1], st->coalesce[2],
+	       st->coalesce[3], st->sbrks, st->realloc_copies,
+	       st->realloc_bytes / 1024.0);
+	for (k = classes; k < MM_CLASSES; k++)
+	    if (st->class_blocks[k])
+		classes = k + 1;
+    }
+
+    printf("\nFree blocks at the peak of live bytes:\n%5s%10s%8s%10s", 
+	   "trace", "free KB",
+	   "blocks", "max KB");
+    for (k = 0; k < classes; k++)
+	printf("%7s", k < MM_CLASSES - 1 ? 
+	       size_label((size_t)32 << k, buf) : "more");
+    printf("\n");
+    for (i=0; i < n; i++) {
+	st = &stats[i].pkg;
+	printf("%2d   ", i);
+	if (!stats[i].valid || !stats[i].has_pkg) {
+	    printf("%10s%8s%10s\n", "-", "-", "-");
+	    continue;
+	}
+	printf("%10.0f%8lu%10.0f", st->free_bytes / 1024.0,
+	       (unsigned long)st->free_blocks, st->largest_free / 1024.0);
+	for (k = 0; k < classes; k++)
+	    printf("%7lu", (unsigned long)st->class_blocks[k]);
+	printf("\n");
+    }
+}
+
+/*
+ * size_label - writes "<bytes" into buf, in K if it is a whole number 
+ *     of them, and returns buf
+ */
+static char *size_label(size_t bytes, char *buf)
+{
+    if (bytes >= 1024 && bytes % 1024 == 0)
+	sprintf(buf, "<%luK", (unsigned long)(bytes / 1024));
+    else
+	sprintf(buf, "<%lu", (unsigned long)bytes);
+    return buf;
+}
+
+/*
+ * score_package - compute the perf index of an mm package from its
+ *     stats on the n traces. It is 0 if there were any errors.
+ */
+static void score_package(package_t *pkg, int n)
+{
+    double secs = 0, ops = 0, util = 0, throughput;
+    int i;
+
+    pkg->numcorrect = 0;
+    for (i=0; i < n; i++) {
+	secs += pkg->stats[i].secs;
+	ops += pkg->stats[i].ops;
+	util += pkg->stats[i].util;
+	if (pkg->stats[i].valid)
+	    pkg->numcorrect++;
+    }
+    if (pkg->errors) {
+	pkg->p1 = pkg->p2 = 0.0;
+	return;
+    }
+
+    throughput = ops/secs;
+    pkg->p1 = UTIL_WEIGHT * util/n;
+    if (throughput > AVG_LIBC_THRUPUT)
+	pkg->p2 = (double)(1.0 - UTIL_WEIGHT);
+    else
+	pkg->p2 = ((double) (1.0 - UTIL_WEIGHT)) * 
+	    (throughput/AVG_LIBC_THRUPUT);
+}
+
+/*
+ * printscore - prints the perf index of an mm package, with its name
+ *     if named is set
+ */
+static void printscore(package_t *pkg, int named)
+{
+    if (pkg->errors) {
+	if (named)
+	    printf("%s: ", pkg->backend->name);
+	printf("Terminated with %d errors\n", pkg->errors);
+	return;
+    }
+    printf("Perf index%s%s = %.0f (util) + %.0f (thru) = %.0f/100\n",
+	   named ? " for " : "", named ? pkg->backend->name : "",
+	   pkg->p1*100, 
+	   pkg->p2*100, 
+	   (pkg->p1 + pkg->p2)*100.0);
+}
+
+/*
+ * printcompare - prints the util and throughput of several mm packages
+ *     side by side, one column per package
+ */
+static void printcompare(int n, package_t *packages, int num_packages) 
+{
+    stats_t *st;
+    double secs, ops, util;
+    int i, k;
+
+    printf("Results side by side (util, Kops):\n%5s", "trace");
+    for (k = 0; k < num_packages; k++)
+	printf("%15s", packages[k].backend->name);
+    printf("\n");
+    for (i=0; i <= n; i++) {
+	if (i < n)
+	    printf("%2d   ", i);
+	else
+	    printf("Total");
+	for (k = 0; k < num_packages; k++) {
+	    if (i < n) {
+		st = &packages[k].stats[i];
+		if (st->valid)
+		    printf("%6.0f%%%8.0f", st->util*100.0, 
+			   (st->ops/1e3)/st->secs);
+		else
+		    printf("%7s%8s", "-", "-");
+		continue;
+	    }
+	    if (packages[k].errors) {
+		printf("%7s%8s", "-", "-");
+		continue;
+	    }
+	    secs = ops = util = 0;
+	    for (st = packages[k].stats; st < packages[k].stats + n; st++) {
+		secs += st->secs;
+		ops += st->ops;
+		util += st->util;
+	    }
+	    printf("%6.0f%%%8.0f", (util/n)*100.0, (ops/1e3)/secs);
+	}
+	printf("\n");
+    }
+    printf("\n");
+}
+
+/*
+ * printbaseline - prints the util and throughput of an mm package on
+ *     each trace, and in total, next to those in the baseline bl and
+ *     the changes, and returns how many of them are regressions (see
+ *     compare_row). A trace that is no longer valid is a regression too.
+ *     The total compares the traces valid on both sides: their average
+ *     util, and their ops over their secs.
+ */
+static int printbaseline(char **tracefiles, int n, package_t *pkg, 
+			 baseline_t *bl)
+{
+    stats_t *st;
+    bl_entry_t *b;
+    double secs = 0, ops = 0, util = 0, var = 0, rel;
+    double bl_secs = 0, bl_ops = 0, bl_util = 0, bl_var = 0, bl_rel;
+    int i, compared = 0, known = 1, regressions = 0;
+    char label[16];
+
+    printf("%5s%8s%8s%8s%10s%10s%8s%7s\n", "trace", "util", "was", 
+	   "change", "Kops", "was", "change", "z");
+    for (i = 0; i < n; i++) {
+	st = &pkg->stats[i];
+	b = bl_find(bl, pkg->backend->name, trace_name(tracefiles[i]));
+	sprintf(label, "%2d", i);
+	if (b == NULL || !b->valid || !st->valid) {
+	    printf("%-5s", label);
+	    if (st->valid)
+		printf("%7.1f%%%8s%8s%10.0f%10s%8s%7s", st->util*100.0, "-",
+		       "", (st->ops/1e3)/st->secs, "-", "", "");
+	    else
+		printf("%8s%8s%8s%10s%10s%8s%7s", "-", "", "", "-", "", "",
+		       "");
+	    if (b == NULL)
+		printf("  not in the baseline\n");
+	    else if (!b->valid)
+		printf("  invalid in the baseline\n");
+	    else {
+		printf("  REGRESSED (no longer valid)\n");
+		regressions++;
+	    }
+	    continue;
+	}
+
+	rel = bl_relerr(st->spread, st->runs);
+	bl_rel = bl_relerr(b->spread, b->runs);
+	regressions += compare_row(label, st->util, b->util, 
+				   (st->ops/1e3)/st->secs, 
+				   (b->ops/1e3)/b->secs, rel, bl_rel);
+
+	compared++;
+	secs += st->secs;
+	ops += st->ops;
+	util += st->util;
+	bl_secs += b->secs;
+	bl_ops += b->ops;
+	bl_util += b->util;
+	if (rel < 0 || bl_rel < 0)
+	    known = 0;
+	var += (st->secs*rel) * (st->secs*rel);
+	bl_var += (b->secs*bl_rel) * (b->secs*bl_rel);
+    }
+    if (compared > 1)
+	regressions += compare_row("Total", util/compared, bl_util/compared,
+				   (ops/1e3)/secs, (bl_ops/1e3)/bl_secs, 
+				   known ? sqrt(var)/secs : -1,
+				   known ? sqrt(bl_var)/bl_secs : -1);
+    return regressions;
+}
+
+/*
+ * compare_row - prints one line of printbaseline, and returns 1 if it
+ *     is a regression: util fell by more than tol_util points, or
+ *     throughput by more than tol_kops percent and significantly. The
+ *     change in throughput is significant if its z score, the change
+ *     (in log terms) over its standard error, is at least BL_Z; the
+ *     standard error comes from the relative standard errors of the
+ *     timings on both sides, relerr and bl_relerr. If either isn't
+ *     known (-S times a single pass), every change counts.
+ */
+static int compare_row(char *label, double util, double bl_util, 
+		       double kops, double bl_kops, double relerr, 
+		       double bl_relerr)
+{
+    double du = (util - bl_util)*100.0, dk = (kops/bl_kops - 1)*100.0;
+    double se = sqrt(relerr*relerr + bl_relerr*bl_relerr), z = 0;
+    int known = relerr >= 0 && bl_relerr >= 0, significant, regressed;
+
+    if (fabs(du) < 0.05)
+	du = 0;  /* don't print rounding noise as -0.0 */
+    if (known && se > 0)
+	z = log(kops/bl_kops) / se;
+    significant = !known || (se > 0 ? fabs(z) >= BL_Z : kops != bl_kops);
+    regressed = du < -tol_util || (dk < -tol_kops && significant);
+
+    printf("%-5s%7.1f%%%7.1f%%%+8.1f%10.0f%10.0f%+7.1f%%", label, 
+	   util*100.0, bl_util*100.0, du, kops, bl_kops, dk);
+    if (known && se > 0)
+	printf("%7.1f", z);
+    else
+	printf("%7s", "-");
+    if (regressed)
+	printf("  REGRESSED\n");
+    else if (du > tol_util || (dk > tol_kops && significant))
+	printf("  improved\n");
+    else
+	printf("\n");
+    return regressed;
+}
+
+/*
+ * printbaselat - prints how the median and 99th percentile latencies of
+ *     each type of request changed since the baseline bl, in percent,
+ *     for the traces it has latencies for
+ */
+static void printbaselat(char **tracefiles, int n, package_t *pkg, 
+			 baseline_t *bl)
+{
+    static char *names[3] = {"malloc", "free", "realloc"};
+    lat_summary_t *l;
+    bl_entry_t *b;
+    int i, t;
+
+    printf("\nLatency changes since the baseline (%%):\n%5s", "trace");
+    for (t = 0; t < 3; t++)
+	printf("%9s p50%5s", names[t], "p99");
+    printf("\n");
+    for (i = 0; i < n; i++) {
+	b = bl_find(bl, pkg->backend->name, trace_name(tracefiles[i]));
+	if (b == NULL || !b->valid || !pkg->stats[i].valid)
+	    continue;
+	printf("%2d   ", i);
+	for (t = 0; t < 3; t++) {
+	    l = &pkg->stats[i].lat[t];
+	    if (l->n == 0 || b->p50[t] == 0 || b->p99[t] == 0) {
+		printf("%13s%5s", "-", "-");
+		continue;
+	    }
+	    printf("%+13.0f%+5.0f", (100.0*l->p50/b->p50[t]) - 100,
+		   (100.0*l->p99/b->p99[t]) - 100);
+	}
+	printf("\n");
+    }
+}
+
+/*
+ * save_baseline - save the results of the mm packages to the baseline
+ *     file path, for --compare
+ */
+static void save_baseline(char *path, char **tracefiles, int n, 
+			  package_t *packages, int num_packages)
+{
+    bl_entry_t e;
+    stats_t *st;
+    FILE *fp;
+    int i, k, t;
+
+    if ((fp = bl_create(path, fsecs_method())) == NULL)
+	unix_error("Could not create the baseline file");
+    for (k = 0; k < num_packages; k++) {
+	for (i = 0; i < n; i++) {
+	    st = &packages[k].stats[i];
+	    memset(&e, 0, sizeof(e));
+	    strcpy(e.package, packages[k].backend->name); /* checked by main */
+	    strcpy(e.trace, trace_name(tracefiles[i]));
+	    e.valid = st->valid;
+	    if (st->valid) {
+		e.util = st->util;
+		e.ops = st->ops;
+		e.secs = st->secs;
+		e.spread = st->spread;
+		e.runs = st->runs;
+		for (t = 0; t < 3; t++) {
+		    e.p50[t] = st->lat[t].n ? st->lat[t].p50 : 0;
+		    e.p99[t] = st->lat[t].n ? st->lat[t].p99 : 0;
+		}
+	    }
+	    bl_write(fp, &e);
+	}
+    }
+    if (fclose(fp) != 0)
+	unix_error("Could not write the baseline file");
+}
+
+/*
+ * trace_name - a trace's file name less any directory, which is what
+ *     baselines know it by
+ */
+static char *trace_name(char *filename)
+{
+    return strrchr(filename, '/') ? strrchr(filename, '/') + 1 : filename;
+}
+
+/*
+ * printreport - prints the results of the run to fp as JSON or CSV 
+ *     (--format): the per-trace numbers for each mm package and for 
+ *     libc if it was run (libc_stats isn't NULL), the totals and perf
+ *     indexes, and how and where they were measured. The top-level
+ *     errors and perf index are those of the first mm package.
+ */
+static void printreport(FILE *fp, int format, char **tracefiles, int n, 
+			package_t *packages, int num_packages, 
+			stats_t *libc_stats)
+{
+    runinfo_t run;
+    time_t now = time(NULL);
+    package_t *pkg;
+
+    run.timer = fsecs_method();
+    run.cflags = BUILD_CFLAGS;
+    run.compiler = "gcc " __VERSION__;
+    if (uname(&run.uts) < 0)
+	unix_error("uname failed in printreport");
+    sprintf(run.os, "%s %s", run.uts.sysname, run.uts.release);
+    run.cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    strftime(run.date, sizeof(run.date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+    if (format == FORMAT_CSV) {
+	fprintf(fp, "package,trace,file,valid,util,ops,secs,kops,spread,perfidx,"
+		"timer,cflags,compiler,host,os,machine,cpus,date\n");
+	if (libc_stats != NULL)
+	    csv_stats(fp, "libc", tracefiles, n, libc_stats, -1, &run);
+	for (pkg = packages; pkg < packages + num_packages; pkg++)
+	    csv_stats(fp, pkg->backend->name, tracefiles, n, pkg->stats, 
+		      (pkg->p1 + pkg->p2)*100.0, &run);
+	return;
+    }
+
+    fprintf(fp, "{\n  \"timer\": ");
+    put_string(fp, run.timer, format);
+    fprintf(fp, ",\n  \"build\": {\"cflags\": ");
+    put_string(fp, run.cflags, format);
+    fprintf(fp, ", \"compiler\": ");
+    put_string(fp, run.compiler, format);
+    fprintf(fp, "},\n  \"host\": {\"name\": ");
+    put_string(fp, run.uts.nodename, format);
+    fprintf(fp, ", \"os\": ");
+    put_string(fp, run.os, format);
+    fprintf(fp, ", \"machine\": ");
+    put_string(fp, run.uts.machine, format);
+    fprintf(fp, ", \"cpus\": %ld},\n", run.cpus);
+    fprintf(fp, "  \"date\": \"%s\",\n", run.date);
+    if (libc_stats != NULL) {
+	json_stats(fp, "libc", tracefiles, n, libc_stats, -1);
+	fprintf(fp, ",\n");
+    }
+    for (pkg = packages; pkg < packages + num_packages; pkg++) {
+	json_stats(fp, pkg->backend->name, tracefiles, n, pkg->stats, 
+		   (pkg->p1 + pkg->p2)*100.0);
+	fprintf(fp, ",\n");
+    }
+    fprintf(fp, "  \"errors\": %d,\n", packages->errors);
+    fprintf(fp, "  \"perfidx\": {\"util\": %.2f, \"thru\": %.2f, "
+	    "\"total\": %.2f}\n}\n", packages->p1*100, packages->p2*100, 
+	    (packages->p1 + packages->p2)*100);
+}
+
+/*
+ * json_threads - prints the -T replays of one trace as a JSON member,
+ *     with null throughputs for those that failed
+ */
+static void json_threads(FILE *fp, stats_t *stats)
+{
+    mt_result_t *r;
+    int k;
+
+    fprintf(fp, ", \"threads\": [");
+    for (k = 0; k < num_thread_counts; k++) {
+	r = &stats->mt[k];
+	fprintf(fp, "%s{\"threads\": %d, ", k ? ", " : "", thread_counts[k]);
+	if (r->secs > 0)
+	    fprintf(fp, "\"kops\": %.3f, \"thread_kops\": %.3f}", 
+		    (stats->ops*r->threads/1e3)/r->secs,
+		    (stats->ops/1e3)/r->thread_secs);
+	else
+	    fprintf(fp, "\"kops\": null, \"thread_kops\": null}");
+    }
+    fprintf(fp, "]");
+}
+
+/*
+ * json_pkgstats - prints a package's own counters for a trace (-s) as a
+ *     JSON member
+ */
+static void json_pkgstats(FILE *fp, mm_stats_t *st)
+{
+    int k;
+
+    fprintf(fp, ", \"mm_stats\": {\"searches\": %lu, \"search_steps\": %lu, "
+	    "\"splits\": %lu, \"coalesce\": [%lu, %lu, %lu, %lu], "
+	    "\"sbrks\": %lu, \"realloc_copies\": %lu, \"realloc_bytes\": %lu, "
+	    "\"free_bytes\": %lu, \"free_blocks\": %lu, \"largest_free\": %lu, "
+	    "\"class_blocks\": [", st->searches, st->search_steps, st->splits,
+	    st->coalesce[0], st->coalesce[1], st->coalesce[2], st->coalesce[3],
+	    st->sbrks, st->realloc_copies, st->realloc_bytes, 
+	    (unsigned long)st->free_bytes, (unsigned long)st->free_blocks, 
+	    (unsigned long)st->largest_free);
+    for (k = 0; k < MM_CLASSES; k++)
+	fprintf(fp, "%s%lu", k ? ", " : "", (unsigned long)st->class_blocks[k]);
+    fprintf(fp, "]}");
+}
+
+/*
+ * json_stats - prints the per-trace results and totals of one malloc
+ *     package as the JSON member name. The totals include perfindex
+ *     unless it is negative.
+ */
+static void json_stats(FILE *fp, char *name, char **tracefiles, int n, 
+		       stats_t *stats, double perfindex)
+{
+    int i;
+    double secs = 0, ops = 0, util = 0;
+
+    fprintf(fp, "  \"%s\": {\n    \"traces\": [\n", name);
+    for (i = 0; i < n; i++) {
+	fprintf(fp, "      {\"trace\": %d, \"file\": ", i);
+	put_string(fp, tracefiles[i], FORMAT_JSON);
+	if (stats[i].valid) {
+	    fprintf(fp, ", \"valid\": true, \"util\": %.6f, \"ops\": %.0f, "
+		    "\"secs\": %.6f, \"kops\": %.3f", stats[i].util, 
+		    stats[i].ops, stats[i].secs, 
+		    (stats[i].ops/1e3)/stats[i].secs);
+	    if (stats[i].spread >= 0)
+		fprintf(fp, ", \"spread\": %.6f", stats[i].spread);
+	    if (stats[i].cold_secs > 0)
+		fprintf(fp, ", \"cold_kops\": %.3f", 
+			(stats[i].ops/1e3)/stats[i].cold_secs);
+	    if (num_thread_counts)
+		json_threads(fp, &stats[i]);
+	    if (stats[i].has_pkg)
+		json_pkgstats(fp, &stats[i].pkg);
+	    fprintf(fp, "}");
+	    secs += stats[i].secs;
+	    ops += stats[i].ops;
+	    util += stats[i].util;
+	}
+	else
+	    fprintf(fp, ", \"valid\": false}");
+	fprintf(fp, "%s\n", i < n-1 ? "," : "");
+    }
+    fprintf(fp, "    ],\n    \"total\": {\"util\": %.6f, \"ops\": %.0f, "
+	    "\"secs\": %.6f, \"kops\": %.3f", util/n, ops, secs, 
+	    secs > 0 ? (ops/1e3)/secs : 0.0);
+    if (perfindex >= 0)
+	fprintf(fp, ", \"perfidx\": %.2f", perfindex);
+    fprintf(fp, "}\n  }");
+}
+
+/*
+ * csv_stats - prints a CSV row for each trace run with one malloc 
+ *     package and one for its totals, which also carries perfindex 
+ *     unless it is negative. Every row repeats the run information so
+ *     that rows can be compared across files.
+ */
+static void csv_stats(FILE *fp, char *name, char **tracefiles, int n, 
+		      stats_t *stats, double perfindex, runinfo_t *run)
+{
+    int i;
+    double secs = 0, ops = 0, util = 0;
+
+    for (i = 0; i <= n; i++) {
+	if (i < n) {
+	    fprintf(fp, "%s,%d,", name, i);
+	    put_string(fp, tracefiles[i], FORMAT_CSV);
+	}
+	else
+	    fprintf(fp, "%s,total,", name);
+
+	if (i == n)
+	    fprintf(fp, ",,%.6f,%.0f,%.6f,%.3f,,", util/n, ops, secs, 
+		    secs > 0 ? (ops/1e3)/secs : 0.0);
+	else if (stats[i].valid) {
+	    fprintf(fp, ",1,%.6f,%.0f,%.6f,%.3f,", stats[i].util, 
+		    stats[i].ops, stats[i].secs, 
+		    (stats[i].ops/1e3)/stats[i].secs);
+	    if (stats[i].spread >= 0)
+		fprintf(fp, "%.6f", stats[i].spread);
+	    fprintf(fp, ",");
+	    secs += stats[i].secs;
+	    ops += stats[i].ops;
+	    util += stats[i].util;
+	}
+	else
+	    fprintf(fp, ",0,,,,,,");
+
+	if (i == n && perfindex >= 0)
+	    fprintf(fp, "%.2f", perfindex);
+	fprintf(fp, ",");
+	put_string(fp, run->timer, FORMAT_CSV);
+	fprintf(fp, ",");
+	put_string(fp, run->cflags, FORMAT_CSV);
+	fprintf(fp, ",");
+	put_string(fp, run->compiler, FORMAT_CSV);
+	fprintf(fp, ",");
+	put_string(fp, run->uts.nodename, FORMAT_CSV);
+	fprintf(fp, ",");
+	put_string(fp, run->os, FORMAT_CSV);
+	fprintf(fp, ",");
+	put_string(fp, run->uts.machine, FORMAT_CSV);
+	fprintf(fp, ",%ld,%s\n", run->cpus, run->date);
+    }
+}
+
+/*
+ * put_string - prints s as a quoted JSON or CSV string
+ */
+static void put_string(FILE *fp, char *s, int format)
+{
+    putc('"', fp);
+    for (; *s; s++) {
+	if (format == FORMAT_CSV) {
+	    if (*s == '"')
+		putc('"', fp); /* CSV doubles quotes */
+	    putc(*s, fp);
+	}
+	else if (*s == '"' || *s == '\\')
+	    fprintf(fp, "\\%c", *s);
+	else if ((unsigned char)*s < ' ')
+	    fprintf(fp, "\\u%04x", *s);
+	else
+	    putc(*s, fp);
+    }
+    putc('"', fp);
+}
+
 /* 
  * app_error - Report an arbitrary application error
  */
@@ -998,13 +2906,230 @@ void unix_error(char *msg)
     exit(1);
 }
 
+/*********************************************************************
+ * The following routines manipulate the live block table, which maps
+ * the ids of the currently allocated blocks to their payloads during 
+ * streaming replay. It uses linear probing and grows when half full.
+ ********************************************************************/
+
+/* Hash a block id to a slot */
+#define LIVE_HASH(id, mask) \
+    ((size_t)(((id) * 0x9E3779B97F4A7C15ULL) >> 32) & (mask))
+
+/*
+ * live_find - returns the entry of block id, or NULL if it isn't live
+ */
+static live_t *live_find(livetab_t *tab, unsigned long long id)
+{
+    size_t i;
+
+    if (tab->v == NULL)
+	return NULL;
+    for (i = LIVE_HASH(id, tab->mask); tab->v[i].key; i = (i+1) & tab->mask)
+	if (tab->v[i].key == id + 1)
+	    return &tab->v[i];
+    return NULL;
+}
+
+/*
+ * live_insert - remember that block id (not currently live) is allocated,
+ *     and return the block slot it is given
+ */
+static size_t live_insert(livetab_t *tab, unsigned long long id, 
+			  unsigned long long size)
+{
+    live_t *old = tab->v;
+    size_t oldslots = old ? tab->mask + 1 : 0;
+    size_t i, j;
+
+    /* Keep the table at most half full */
+    if (2*(tab->n + 1) > oldslots) {
+	size_t slots = oldslots ? 2*oldslots : 1024;
+	if ((tab->v = (live_t *)calloc(slots, sizeof(live_t))) == NULL)
+	    unix_error("calloc error in live_insert");
+	tab->mask = slots - 1;
+
+	/* There are never more block slots than half the entries */
+	tab->blocks = (char **)realloc(tab->blocks, 
+				       slots/2 * sizeof(char *));
+	tab->spare = (size_t *)realloc(tab->spare, slots/2 * sizeof(size_t));
+	if (tab->blocks == NULL || tab->spare == NULL)
+	    unix_error("realloc error in live_insert");
+	for (j = 0; j < oldslots; j++) {
+	    if (!old[j].key)
+		continue;
+	    for (i = LIVE_HASH(old[j].key - 1, tab->mask); tab->v[i].key; 
+		 i = (i+1) & tab->mask)
+		;
+	    tab->v[i] = old[j];
+	}
+	free(old);
+    }
+
+    for (i = LIVE_HASH(id, tab->mask); tab->v[i].key; i = (i+1) & tab->mask)
+	;
+    tab->v[i].key = id + 1;
+    tab->v[i].slot = tab->nspare ? tab->spare[--tab->nspare] : tab->nslots++;
+    tab->v[i].size = size;
+    tab->n++;
+    return tab->v[i].slot;
+}
+
+/*
+ * live_remove - forget the entry l, shifting back later entries of the
+ *     same probe run so that no tombstones are needed
+ */
+static void live_remove(livetab_t *tab, live_t *l)
+{
+    size_t hole = l - tab->v;
+    size_t i, home;
+
+    tab->spare[tab->nspare++] = l->slot;
+    for (i = (hole+1) & tab->mask; tab->v[i].key; i = (i+1) & tab->mask) {
+	home = LIVE_HASH(tab->v[i].key - 1, tab->mask);
+	/* move entry i into the hole unless its home lies in (hole, i] */
+	if (((i - home) & tab->mask) >= ((i - hole) & tab->mask)) {
+	    tab->v[hole] = tab->v[i];
+	    hole = i;
+	}
+    }
+    tab->v[hole].key = 0;
+    tab->n--;
+}
+
+/*
+ * wallclock - returns the current time in seconds
+ */
+static double wallclock(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + 1e-6 * tv.tv_usec;
+}
+
+/*
+ * parse_size - Convert a byte count with an optional K, M or G suffix
+ *     to a number of bytes. Returns 0 if str is not a valid size.
+ */
+static size_t parse_size(char *str)
+{
+    char *end;
+    unsigned long long val = strtoull(str, &end, 10);
+
+    switch (*end) {
+    case 'g': case 'G':
+	val <<= 10;
+	/* fall through */
+    case 'm': case 'M':
+	val <<= 10;
+	/* fall through */
+    case 'k': case 'K':
+	val <<= 10;
+	end++;
+	break;
+    }
+    if (*end != '\0' || val != (size_t)val)
+	return 0;
+    return (size_t)val;
+}
+
+/*
+ * parse_threads - parse the -T list of thread counts, separated by 
+ *     commas, into thread_counts. Returns how many there are, or 0 if
+ *     the list is malformed or too long.
+ */
+static int parse_threads(char *str)
+{
+    char *end;
+    long val;
+    int n = 0;
+
+    do {
+	val = strtol(str, &end, 10);
+	if (end == str || val < 1 || val > MT_MAX_THREADS || 
+	    n == MT_MAX_COUNTS || (*end != ',' && *end != '\0'))
+	    return 0;
+	thread_counts[n++] = (int)val;
+	str = end + 1;
+    } while (*end == ',');
+    return n;
+}
+
+/*
+ * parse_snapshots - parse the --snapshot list of request numbers, in
+ *     increasing order and separated by commas, into snap_ops. "end"
+ *     (last) stands for the end of each trace. Returns how many there
+ *     are, or 0 if the list is malformed or too long.
+ */
+static int parse_snapshots(char *str)
+{
+    char *end;
+    long val;
+    int n = 0;
+
+    do {
+	if (!strncmp(str, "end", 3)) {
+	    val = SNAP_END;
+	    end = str + 3;
+	    if (*end != '\0')
+		return 0;
+	}
+	else {
+	    val = strtol(str, &end, 10);
+	    if (end == str || val < 0 || val > INT_MAX ||
+		(n > 0 && val <= snap_ops[n-1]))
+		return 0;
+	}
+	if (n == MAX_SNAPS || (*end != ',' && *end != '\0'))
+	    return 0;
+	snap_ops[n++] = (int)val;
+	str = end + 1;
+    } while (*end == ',');
+    return n;
+}
+
+/*
+ * parse_tolerance - parse the --tolerance throughput percentage and,
+ *     after a comma, util points into tol_kops and tol_util. Returns 0
+ *     if it is malformed.
+ */
+static int parse_tolerance(char *str)
+{
+    char *end;
+
+    tol_kops = strtod(str, &end);
+    if (end == str || tol_kops < 0)
+	return 0;
+    if (*end == ',') {
+	str = end + 1;
+	tol_util = strtod(str, &end);
+	if (end == str || tol_util < 0)
+	    return 0;
+    }
+    return *end == '\0';
+}
+
+/*
+ * out_path - the name of the file an output for the trace in filename
+ *     goes in: <trace name>.<suffix> in the cwd, or 
+ *     <trace name>.<package>.<suffix> for packages but mm
+ */
+static void out_path(char *path, char *filename, char *suffix)
+{
+    char *base = strrchr(filename, '/') ? strrchr(filename, '/') + 1 : filename;
+
+    sprintf(path, "%.*s%s%s.%s", (int)strcspn(base, "."), base,
+	    mm == backends ? "" : ".", mm == backends ? "" : mm->name, suffix);
+}
+
 /*
  * malloc_error - Report an error returned by the mm_malloc package
  */
-void malloc_error(int tracenum, int opnum, char *msg)
+void malloc_error(int tracenum, long opnum, char *msg)
 {
     errors++;
-    printf("ERROR [trace %d, line %d]: %s\n", tracenum, LINENUM(opnum), msg);
+    printf("ERROR [trace %d, line %ld]: %s\n", tracenum, LINENUM(opnum), msg);
 }
 
 /* 
@@ -1012,14 +3137,65 @@ void malloc_error(int tracenum, int opnum, char *msg)
  */
 static void usage(void) 
 {
-    fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>]\n");
+    backend_t *b;
+
+    fprintf(stderr, "Usage: mdriver [-hvValLPHSCcs] [-f <file>] [-t <dir>] [-m <size>]\n");
+    fprintf(stderr, "               [-j <n>] [-F <n>] [-T <list>] [-b <list>]\n");
+    fprintf(stderr, "               [--alloc=<file.so>]...\n");
+    fprintf(stderr, "               [--format=json|csv] [--cold] [--snapshot=<list>]\n");
+    fprintf(stderr, "               [--save-baseline=<file>] [--compare=<file>]\n");
+    fprintf(stderr, "               [--tolerance=<kops%%>[,<util>]] [--list-check]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-a         Don't check the team structure.\n");
+    fprintf(stderr, "\t--alloc=<file.so>\n");
+    fprintf(stderr, "\t           Evaluate the mm package in a shared object as well\n");
+    fprintf(stderr, "\t           (only those, and any -b ones, if given).\n");
+    fprintf(stderr, "\t-b <list>  Evaluate the mm packages in <list>, separated by\n");
+    fprintf(stderr, "\t           commas, or \"all\" (default mm). Have:");
+    for (b = backends; b->name != NULL; b++)
+	fprintf(stderr, " %s", b->name);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "\t-c         Count hardware events per request (perf_event_open).\n");
+    fprintf(stderr, "\t-C         Pin each -j worker to its own CPU.\n");
+    fprintf(stderr, "\t--compare=<file>\n");
+    fprintf(stderr, "\t           Compare util, Kops and (with -L) latencies with a\n");
+    fprintf(stderr, "\t           saved baseline, and exit with status 2 if any fell\n");
+    fprintf(stderr, "\t           further than the tolerance.\n");
+    fprintf(stderr, "\t--cold     Time each trace with the caches flushed before\n");
+    fprintf(stderr, "\t           each run as well.\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
+    fprintf(stderr, "\t-F <n>     Write <trace>.frag.csv, sampling every <n> requests.\n");
+    fprintf(stderr, "\t--format=json|csv\n");
+    fprintf(stderr, "\t           Write the results to stdout as JSON or CSV (the\n");
+    fprintf(stderr, "\t           rest of the output goes to stderr).\n");
     fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-H         Back the heap with transparent huge pages.\n");
+    fprintf(stderr, "\t-j <n>     Evaluate <n> traces at once in worker processes.\n");
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+    fprintf(stderr, "\t-L         Report per-request latency percentiles.\n");
+    fprintf(stderr, "\t--list-check\n");
+    fprintf(stderr, "\t           Check each payload against every other one, as the\n");
+    fprintf(stderr, "\t           driver used to (slow; for timing the check with -V).\n");
+    fprintf(stderr, "\t-m <size>  Reserve <size> bytes (K/M/G suffix) for the heap.\n");
+    fprintf(stderr, "\t-P         Pre-fault heap pages as they are committed.\n");
+    fprintf(stderr, "\t-s         Report the mm packages' own counters (mm_stats).\n");
+    fprintf(stderr, "\t--save-baseline=<file>\n");
+    fprintf(stderr, "\t           Save the results to <file> for --compare.\n");
+    fprintf(stderr, "\t--snapshot=<list>\n");
+    fprintf(stderr, "\t           Write every block in the heap to <trace>.snap after\n");
+    fprintf(stderr, "\t           each number of requests in <list>, e.g. 0,500,end\n");
+    fprintf(stderr, "\t           (see snapview).\n");
+    fprintf(stderr, "\t-S         Stream traces from disk in one timed pass.\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
+    fprintf(stderr, "\t--tolerance=<kops%%>[,<util>]\n");
+    fprintf(stderr, "\t           How many percent Kops (significant changes only)\n");
+    fprintf(stderr, "\t           and util points may be lost before --compare\n");
+    fprintf(stderr, "\t           calls it a regression (default %.0f,%.0f).\n", 
+	    TOL_KOPS, TOL_UTIL);
+    fprintf(stderr, "\t-T <list>  Also replay copies of each trace on each number of\n");
+    fprintf(stderr, "\t           threads in <list>, e.g. 1,2,4 (mm packages run\n");
+    fprintf(stderr, "\t           behind a global lock).\n");
     fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
     fprintf(stderr, "\t-V         Print additional debug info.\n");
 }
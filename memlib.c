@@ -2,6 +2,24 @@
  * memlib.c - a module that simulates the memory system.  Needed because it 
  *            allows us to interleave calls from the student's malloc package 
  *            with the system's malloc package in libc.
+ *
+ *            Each simulated heap (mem_heap_t) is an mmap reservation that
+ *            starts out inaccessible. Pages are committed (made readable
+ *            and writable) in COMMIT_CHUNK steps as the heap's brk pointer
+ *            advances, and can optionally be pre-faulted so that page-fault
+ *            cost is paid at commit time rather than inside the allocator.
+ *            In huge page mode the reservation is aligned to HUGEPAGE_SIZE
+ *            and marked with MADV_HUGEPAGE so the kernel can back it with
+ *            transparent huge pages. Whole pages inside a range the
+ *            allocator no longer needs can be decommitted (returned to the
+ *            OS while staying mapped) and recommitted before reuse.
+ *            Every heap counts its sbrk calls, peak size and commit
+ *            activity; see mem_get_stats.
+ *
+ *            Any number of heaps can exist at once. The classic mem_xxx
+ *            functions operate on the calling thread's current heap, which
+ *            is the default heap created by mem_init unless mem_use_heap
+ *            selects another one.
  */
 #include <stdio.h>
 #include <stdlib.h>
@@ -10,28 +28,99 @@
 #include <sys/mman.h>
 #include <string.h>
 #include <errno.h>
+#include <sys/resource.h>
 
 #include "memlib.h"
 #include "config.h"
 
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+
+#define MAXDESC 128          /* max length of the backing description */
+#define RESIDENT_BATCH 4096  /* pages per mincore call in mem_heap_resident */
+#define THP_ENABLED "/sys/kernel/mm/transparent_hugepage/enabled"
+
+/* One simulated heap */
+struct mem_heap {
+    char *start_brk;         /* points to first byte of heap */
+    char *brk;               /* points to last byte of heap */
+    char *max_addr;          /* largest legal heap address */ 
+    char *commit_brk;        /* first byte past the committed pages */
+    size_t max_heap;         /* size of the reservation */
+    size_t commit_chunk;     /* commit granularity */
+    int flags;               /* MEM_PREFAULT and/or MEM_HUGEPAGES */
+    char backing[MAXDESC];   /* which backing the heap ended up using */
+    mem_stats_t stats;       /* counters since the last mem_heap_reset_stats */
+    long minflt_base;        /* minor faults at the last mem_heap_reset_stats */
+};
+
 /* private variables */
-static char *mem_start_brk;  /* points to first byte of heap */
-static char *mem_brk;        /* points to last byte of heap */
-static char *mem_max_addr;   /* largest legal heap address */ 
+static size_t mem_max_heap = MAX_HEAP; /* reservation size for mem_init */
+static int mem_flags = 0;              /* heap flags for mem_init */
+static mem_heap_t *mem_default = NULL; /* the heap created by mem_init */
+static __thread mem_heap_t *mem_cur = NULL; /* this thread's current heap */
+
+/* The heap the mem_xxx wrappers operate on */
+#define CUR_HEAP (mem_cur ? mem_cur : mem_default)
+
+/* function prototypes */
+static int mem_commit(mem_heap_t *heap, char *new_brk);
+static void mem_fault_in(char *lo, size_t len);
+static char *mem_reserve(size_t size, size_t align);
+static int thp_available(void);
+static long minor_faults(void);
+
+/**************************************************
+ * Configuration of the default heap (see mem_init)
+ **************************************************/
+
+/*
+ * mem_set_max_heap - Set the size of the heap reservation made by
+ *     mem_init. Must be called before mem_init.
+ *     Default = MAX_HEAP
+ */
+void mem_set_max_heap(size_t bytes)
+{
+    mem_max_heap = bytes;
+}
+
+/*
+ * mem_set_prefault - When set, pages are faulted in as soon as they
+ *     are committed instead of on first touch by the allocator.
+ *     Default = 0
+ */
+void mem_set_prefault(int prefault)
+{
+    mem_flags = prefault ? (mem_flags | MEM_PREFAULT) : 
+	(mem_flags & ~MEM_PREFAULT);
+}
+
+/*
+ * mem_set_hugepages - When set, mem_init aligns the heap reservation to
+ *     HUGEPAGE_SIZE and asks for transparent huge pages. Falls back to
+ *     normal pages if the kernel can't provide them.
+ *     Default = 0
+ */
+void mem_set_hugepages(int hugepages)
+{
+    mem_flags = hugepages ? (mem_flags | MEM_HUGEPAGES) : 
+	(mem_flags & ~MEM_HUGEPAGES);
+}
+
+/**********************************************
+ * The classic interface, on the current heap
+ **********************************************/
 
 /* 
  * mem_init - initialize the memory system model
  */
 void mem_init(void)
 {
-    /* allocate the storage we will use to model the available VM */
-    if ((mem_start_brk = (char *)malloc(MAX_HEAP)) == NULL) {
-        fprintf(stderr, "mem_init_vm: malloc error\n");
+    if ((mem_default = mem_heap_create(mem_max_heap, mem_flags)) == NULL) {
+        fprintf(stderr, "mem_init_vm: mmap error: %s\n", strerror(errno));
         exit(1);
     }
-
-    mem_max_addr = mem_start_brk + MAX_HEAP;  /* max legal heap address */
-    mem_brk = mem_start_brk;                  /* heap is empty initially */
 }
 
 /* 
@@ -39,15 +128,39 @@ void mem_init(void)
  */
 void mem_deinit(void)
 {
-    free(mem_start_brk);
+    mem_heap_destroy(mem_default);
+    mem_default = NULL;
 }
 
 /*
- * mem_reset_brk - reset the simulated brk pointer to make an empty heap
+ * mem_use_heap - make heap the current heap of the calling thread, so
+ *     that mem_sbrk and friends operate on it. NULL selects the default
+ *     heap. Returns the previously selected heap.
+ */
+mem_heap_t *mem_use_heap(mem_heap_t *heap)
+{
+    mem_heap_t *old = mem_cur;
+
+    mem_cur = heap;
+    return old;
+}
+
+/*
+ * mem_current_heap - returns the heap the calling thread's mem_xxx 
+ *     calls operate on, so that another thread can select it too
+ */
+mem_heap_t *mem_current_heap(void)
+{
+    return CUR_HEAP;
+}
+
+/*
+ * mem_reset_brk - reset the simulated brk pointer to make an empty heap.
+ *     Pages that were already committed stay committed.
  */
 void mem_reset_brk()
 {
-    mem_brk = mem_start_brk;
+    mem_heap_reset_brk(CUR_HEAP);
 }
 
 /* 
@@ -57,15 +170,7 @@ void mem_reset_brk()
  */
 void *mem_sbrk(int incr) 
 {
-    char *old_brk = mem_brk;
-
-    if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
-        errno = ENOMEM;
-        fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
-        return (void *)-1;
-    }
-    mem_brk += incr;
-    return (void *)old_brk;
+    return mem_heap_sbrk(CUR_HEAP, incr);
 }
 
 /*
@@ -73,7 +178,7 @@ void *mem_sbrk(int incr)
  */
 void *mem_heap_lo()
 {
-    return (void *)mem_start_brk;
+    return mem_heap_lo_addr(CUR_HEAP);
 }
 
 /* 
@@ -81,7 +186,7 @@ void *mem_heap_lo()
  */
 void *mem_heap_hi()
 {
-    return (void *)(mem_brk - 1);
+    return mem_heap_hi_addr(CUR_HEAP);
 }
 
 /*
@@ -89,7 +194,74 @@ void *mem_heap_hi()
  */
 size_t mem_heapsize() 
 {
-    return (size_t)(mem_brk - mem_start_brk);
+    return mem_heap_size(CUR_HEAP);
+}
+
+/*
+ * mem_maxheap() - returns the size of the heap reservation in bytes
+ */
+size_t mem_maxheap()
+{
+    return CUR_HEAP->max_heap;
+}
+
+/*
+ * mem_backing() - returns a description of the pages backing the heap
+ */
+const char *mem_backing()
+{
+    return CUR_HEAP->backing;
+}
+
+/*
+ * mem_hugepage_bytes() - returns how many bytes of the heap are currently
+ *     backed by huge pages, according to /proc/self/smaps, or 0 if unknown
+ */
+size_t mem_hugepage_bytes()
+{
+    return mem_heap_hugepage_bytes(CUR_HEAP);
+}
+
+/*
+ * mem_decommit - give the whole pages inside [lo, lo+len) back to the OS.
+ *     The range stays mapped and reads back as zeros. Returns the number
+ *     of bytes released.
+ */
+size_t mem_decommit(void *lo, size_t len)
+{
+    return mem_heap_decommit(CUR_HEAP, lo, len);
+}
+
+/*
+ * mem_recommit - prepare [lo, lo+len) for reuse after mem_decommit
+ */
+void mem_recommit(void *lo, size_t len)
+{
+    mem_heap_recommit(CUR_HEAP, lo, len);
+}
+
+/*
+ * mem_resident() - returns the number of heap bytes resident in memory
+ */
+size_t mem_resident()
+{
+    return mem_heap_resident(CUR_HEAP);
+}
+
+/*
+ * mem_get_stats - fill in *stats with the counters of the current heap
+ */
+void mem_get_stats(mem_stats_t *stats)
+{
+    mem_heap_get_stats(CUR_HEAP, stats);
+}
+
+/*
+ * mem_reset_stats - zero the counters of the current heap
+ */
+void mem_reset_stats()
+{
+    mem_heap_reset_stats(CUR_HEAP);
 }
 
 /*
@@ -99,3 +271,347 @@ size_t mem_pagesize()
 {
     return (size_t)getpagesize();
 }
+
+/**********************************
+ * Operations on an explicit heap
+ **********************************/
+
+/*
+ * mem_heap_create - create a heap that can grow to max_heap bytes.
+ *     flags is a mask of MEM_PREFAULT and MEM_HUGEPAGES. Returns NULL
+ *     (with errno set) if the address space can't be reserved.
+ */
+mem_heap_t *mem_heap_create(size_t max_heap, int flags)
+{
+    mem_heap_t *heap;
+    size_t align = mem_pagesize();
+
+    if ((heap = (mem_heap_t *)calloc(1, sizeof(mem_heap_t))) == NULL)
+	return NULL;
+    heap->flags = flags;
+    heap->commit_chunk = COMMIT_CHUNK;
+    if (flags & MEM_HUGEPAGES) {
+	align = HUGEPAGE_SIZE;
+	heap->commit_chunk = HUGEPAGE_SIZE; /* commit whole huge pages */
+    }
+
+    /* reserve (but don't commit) the address space that models the VM */
+    heap->max_heap = (max_heap + align - 1) & ~(align - 1);
+    if ((heap->start_brk = mem_reserve(heap->max_heap, align)) == NULL) {
+	free(heap);
+	return NULL;
+    }
+
+    heap->max_addr = heap->start_brk + heap->max_heap; /* max legal address */
+    heap->brk = heap->start_brk;                       /* empty initially */
+    heap->commit_brk = heap->start_brk;                /* nothing committed */
+    mem_heap_reset_stats(heap);
+
+    /* describe the backing we ended up with */
+    sprintf(heap->backing, "%lu KB pages", 
+	    (unsigned long)(mem_pagesize() >> 10));
+#ifdef MADV_HUGEPAGE
+    if (flags & MEM_HUGEPAGES) {
+	if (!thp_available())
+	    strcat(heap->backing, " (huge pages disabled in " THP_ENABLED ")");
+	else if (madvise(heap->start_brk, heap->max_heap, MADV_HUGEPAGE) < 0)
+	    sprintf(heap->backing + strlen(heap->backing), 
+		    " (madvise(MADV_HUGEPAGE) failed: %s)", strerror(errno));
+	else
+	    sprintf(heap->backing, "transparent huge pages (%lu KB)", 
+		    (unsigned long)(HUGEPAGE_SIZE >> 10));
+    }
+#else
+    if (flags & MEM_HUGEPAGES)
+	strcat(heap->backing, " (no MADV_HUGEPAGE on this system)");
+#endif
+    return heap;
+}
+
+/*
+ * mem_heap_destroy - release a heap and all of its pages
+ */
+void mem_heap_destroy(mem_heap_t *heap)
+{
+    if (heap == NULL)
+	return;
+    munmap(heap->start_brk, heap->max_heap);
+    free(heap);
+}
+
+/*
+ * mem_heap_reset_brk - reset the brk pointer of heap to make it empty
+ */
+void mem_heap_reset_brk(mem_heap_t *heap)
+{
+    heap->brk = heap->start_brk;
+}
+
+/*
+ * mem_heap_sbrk - extend heap by incr bytes and return the start address
+ *     of the new area, or (void *)-1 if the heap is exhausted
+ */
+void *mem_heap_sbrk(mem_heap_t *heap, int incr)
+{
+    char *old_brk = heap->brk;
+
+    if ( (incr < 0) || ((heap->brk + incr) > heap->max_addr)) {
+        errno = ENOMEM;
+        fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
+        return (void *)-1;
+    }
+    if ((heap->brk + incr > heap->commit_brk) && 
+	(mem_commit(heap, heap->brk + incr) < 0)) {
+        fprintf(stderr, "ERROR: mem_sbrk failed. Could not commit pages: %s\n",
+		strerror(errno));
+        return (void *)-1;
+    }
+    heap->brk += incr;
+
+    heap->stats.sbrk_calls++;
+    heap->stats.sbrk_bytes += incr;
+    if ((size_t)incr > heap->stats.sbrk_max)
+	heap->stats.sbrk_max = incr;
+    if ((size_t)(heap->brk - heap->start_brk) > heap->stats.peak_brk)
+	heap->stats.peak_brk = heap->brk - heap->start_brk;
+    return (void *)old_brk;
+}
+
+/*
+ * mem_heap_lo_addr - return address of the first byte of heap
+ */
+void *mem_heap_lo_addr(mem_heap_t *heap)
+{
+    return (void *)heap->start_brk;
+}
+
+/*
+ * mem_heap_hi_addr - return address of the last byte of heap
+ */
+void *mem_heap_hi_addr(mem_heap_t *heap)
+{
+    return (void *)(heap->brk - 1);
+}
+
+/*
+ * mem_heap_size - returns the size of heap in bytes
+ */
+size_t mem_heap_size(mem_heap_t *heap)
+{
+    return (size_t)(heap->brk - heap->start_brk);
+}
+
+/*
+ * mem_heap_decommit - release the whole pages of heap inside [lo, lo+len)
+ *     with MADV_DONTNEED. Returns the number of bytes released.
+ */
+size_t mem_heap_decommit(mem_heap_t *heap, void *lo, size_t len)
+{
+    size_t pagesize = mem_pagesize();
+    char *start, *end;
+
+    /* only whole pages within the committed part of the heap */
+    start = (char *)(((unsigned long)lo + pagesize - 1) & ~(pagesize - 1));
+    end = (char *)(((unsigned long)lo + len) & ~(pagesize - 1));
+    if (end > heap->commit_brk)
+	end = heap->commit_brk;
+    if (start < heap->start_brk || end <= start)
+	return 0;
+
+    if (madvise(start, end - start, MADV_DONTNEED) < 0)
+	return 0;
+    heap->stats.decommit_calls++;
+    heap->stats.decommit_bytes += end - start;
+    return (size_t)(end - start);
+}
+
+/*
+ * mem_heap_recommit - prepare [lo, lo+len) of heap for reuse. Decommitted
+ *     pages fault back in zero-filled on first touch, so this only does
+ *     work when the heap pre-faults its pages.
+ */
+void mem_heap_recommit(mem_heap_t *heap, void *lo, size_t len)
+{
+    size_t pagesize = mem_pagesize();
+    char *start, *end;
+
+    if (!(heap->flags & MEM_PREFAULT))
+	return;
+    start = (char *)((unsigned long)lo & ~(pagesize - 1));
+    end = (char *)(((unsigned long)lo + len + pagesize - 1) & ~(pagesize - 1));
+    if (end > heap->commit_brk)
+	end = heap->commit_brk;
+    if (end > start)
+	mem_fault_in(start, end - start);
+}
+
+/*
+ * mem_heap_resident - returns the number of bytes of heap (up to its brk)
+ *     that are resident in memory, according to mincore
+ */
+size_t mem_heap_resident(mem_heap_t *heap)
+{
+    static unsigned char vec[RESIDENT_BATCH];
+    size_t pagesize = mem_pagesize();
+    size_t npages, batch, i, resident = 0;
+    char *p = heap->start_brk;
+    char *end = heap->brk;
+
+    while (p < end) {
+	npages = (end - p + pagesize - 1) / pagesize;
+	batch = (npages < RESIDENT_BATCH) ? npages : RESIDENT_BATCH;
+	if (mincore(p, batch * pagesize, vec) < 0)
+	    return 0;
+	for (i = 0; i < batch; i++)
+	    if (vec[i] & 1)
+		resident += pagesize;
+	p += batch * pagesize;
+    }
+    return resident;
+}
+
+/*
+ * mem_heap_get_stats - fill in *stats with the counters of heap. The
+ *     resident size is sampled with mincore, and minor faults are those
+ *     of the whole process since the last mem_heap_reset_stats.
+ */
+void mem_heap_get_stats(mem_heap_t *heap, mem_stats_t *stats)
+{
+    *stats = heap->stats;
+    stats->committed = heap->commit_brk - heap->start_brk;
+    stats->resident = mem_heap_resident(heap);
+    stats->minor_faults = minor_faults() - heap->minflt_base;
+}
+
+/*
+ * mem_heap_reset_stats - zero the counters of heap
+ */
+void mem_heap_reset_stats(mem_heap_t *heap)
+{
+    memset(&heap->stats, 0, sizeof(heap->stats));
+    heap->stats.peak_brk = heap->brk - heap->start_brk;
+    heap->minflt_base = minor_faults();
+}
+
+/*
+ * mem_heap_hugepage_bytes - returns how many bytes of heap are currently
+ *     backed by huge pages, according to /proc/self/smaps, or 0 if unknown
+ */
+size_t mem_heap_hugepage_bytes(mem_heap_t *heap)
+{
+    FILE *fp;
+    char line[256];
+    unsigned long lo, hi, kb;
+    size_t total = 0;
+    int inheap = 0;
+
+    if ((fp = fopen("/proc/self/smaps", "r")) == NULL)
+	return 0;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+	if (sscanf(line, "%lx-%lx ", &lo, &hi) == 2)
+	    inheap = (lo < (unsigned long)heap->max_addr && 
+		      hi > (unsigned long)heap->start_brk);
+	else if (inheap && sscanf(line, "AnonHugePages: %lu kB", &kb) == 1)
+	    total += (size_t)kb << 10;
+    }
+    fclose(fp);
+    return total;
+}
+
+/*
+ * The remaining routines are internal helper routines 
+ */
+
+/*
+ * mem_commit - make the reservation of heap accessible up to at least
+ *     new_brk. Commits whole commit_chunk steps so that small sbrk calls
+ *     don't each cost an mprotect.
+ */
+static int mem_commit(mem_heap_t *heap, char *new_brk)
+{
+    size_t need = (size_t)(new_brk - heap->start_brk);
+    char *end;
+
+    need = (need + heap->commit_chunk - 1) & ~(heap->commit_chunk - 1);
+    end = (need > heap->max_heap) ? heap->max_addr : heap->start_brk + need;
+
+    if (mprotect(heap->commit_brk, end - heap->commit_brk, 
+		 PROT_READ | PROT_WRITE) < 0)
+	return -1;
+    if (heap->flags & MEM_PREFAULT)
+	mem_fault_in(heap->commit_brk, end - heap->commit_brk);
+    heap->commit_brk = end;
+    return 0;
+}
+
+/*
+ * mem_fault_in - populate the pages in [lo, lo+len) up front. Uses
+ *     MADV_POPULATE_WRITE where the kernel supports it and falls back to
+ *     touching one byte per page.
+ */
+static void mem_fault_in(char *lo, size_t len)
+{
+    size_t pagesize = mem_pagesize();
+    volatile char *p;
+
+#ifdef MADV_POPULATE_WRITE
+    if (madvise(lo, len, MADV_POPULATE_WRITE) == 0)
+	return;
+#endif
+    for (p = lo; p < lo + len; p += pagesize)
+	*p = 0;
+}
+
+/*
+ * mem_reserve - reserve size bytes of inaccessible address space whose
+ *     start is aligned to align bytes. Over-reserves by align and trims
+ *     the unaligned head and the excess tail. Returns NULL on error.
+ */
+static char *mem_reserve(size_t size, size_t align)
+{
+    char *raw, *start;
+    size_t slack = (align > mem_pagesize()) ? align : 0;
+
+    raw = (char *)mmap(NULL, size + slack, PROT_NONE, 
+		       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (raw == MAP_FAILED)
+	return NULL;
+
+    start = (char *)(((unsigned long)raw + align - 1) & ~(align - 1));
+    if (start > raw)
+	munmap(raw, start - raw);
+    if (raw + size + slack > start + size)
+	munmap(start + size, (raw + size + slack) - (start + size));
+    return start;
+}
+
+/*
+ * thp_available - returns false if transparent huge pages are turned off
+ *     system-wide. Assumes they are available if we can't tell.
+ */
+static int thp_available(void)
+{
+    FILE *fp;
+    char line[MAXDESC];
+    int avail = 1;
+
+    if ((fp = fopen(THP_ENABLED, "r")) == NULL)
+	return 1;
+    if ((fgets(line, sizeof(line), fp) != NULL) && strstr(line, "[never]"))
+	avail = 0;
+    fclose(fp);
+    return avail;
+}
+
+/*
+ * minor_faults - returns the number of minor page faults taken by the
+ *     process so far
+ */
+static long minor_faults(void)
+{
+    struct rusage ru;
+
+    if (getrusage(RUSAGE_SELF, &ru) < 0)
+	return 0;
+    return ru.ru_minflt;
+}
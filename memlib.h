@@ -1,5 +1,26 @@
 #include <unistd.h>
 
+/* A simulated heap; see mem_heap_create */
+typedef struct mem_heap mem_heap_t;
+
+/* Counters describing how the allocator has used a heap */
+typedef struct {
+    size_t sbrk_calls;      /* number of successful sbrk calls */
+    size_t sbrk_bytes;      /* total bytes those calls added to the heap */
+    size_t sbrk_max;        /* largest single sbrk increment */
+    size_t peak_brk;        /* peak heap size in bytes */
+    size_t committed;       /* bytes of the reservation committed so far */
+    size_t decommit_calls;  /* number of ranges released with mem_decommit */
+    size_t decommit_bytes;  /* total bytes released with mem_decommit */
+    size_t resident;        /* heap bytes currently resident (mincore) */
+    long minor_faults;      /* minor page faults taken by the process */
+} mem_stats_t;
+
+/* Flags for mem_heap_create */
+#define MEM_PREFAULT  0x1  /* pre-fault pages as they are committed */
+#define MEM_HUGEPAGES 0x2  /* back the heap with transparent huge pages */
+
+/* The classic interface, operating on the current heap */
 void mem_init(void);               
 void mem_deinit(void);
 void *mem_sbrk(int incr);
@@ -7,5 +28,34 @@ void mem_reset_brk(void);
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
+size_t mem_maxheap(void);
 size_t mem_pagesize(void);
+const char *mem_backing(void);
+size_t mem_hugepage_bytes(void);
+size_t mem_decommit(void *lo, size_t len);
+void mem_recommit(void *lo, size_t len);
+size_t mem_resident(void);
+void mem_get_stats(mem_stats_t *stats);
+void mem_reset_stats(void);
+
+/* Configure the default heap; must be called before mem_init */
+void mem_set_max_heap(size_t bytes);
+void mem_set_prefault(int prefault);
+void mem_set_hugepages(int hugepages);
 
+/* Explicit heap instances */
+mem_heap_t *mem_heap_create(size_t max_heap, int flags);
+void mem_heap_destroy(mem_heap_t *heap);
+mem_heap_t *mem_use_heap(mem_heap_t *heap);
+mem_heap_t *mem_current_heap(void);
+void *mem_heap_sbrk(mem_heap_t *heap, int incr);
+void mem_heap_reset_brk(mem_heap_t *heap);
+void *mem_heap_lo_addr(mem_heap_t *heap);
+void *mem_heap_hi_addr(mem_heap_t *heap);
+size_t mem_heap_size(mem_heap_t *heap);
+size_t mem_heap_hugepage_bytes(mem_heap_t *heap);
+size_t mem_heap_decommit(mem_heap_t *heap, void *lo, size_t len);
+void mem_heap_recommit(mem_heap_t *heap, void *lo, size_t len);
+size_t mem_heap_resident(mem_heap_t *heap);
+void mem_heap_get_stats(mem_heap_t *heap, mem_stats_t *stats);
+void mem_heap_reset_stats(mem_heap_t *heap);
@@ -33,6 +33,24 @@
  *         head |       node(c)    node(b)    node(a) 
  *   NULL <-    | NULL <-         <-         <-
  *
+ *  Free nodes with a payload of DECOMMIT_THRESHOLD bytes or more give the
+ * whole pages inside their payload back to the OS with mem_decommit. This is
+ * done lazily: a large freed node waits in a small queue and is only decommitted
+ * once DECOMMIT_DELAY more frees have gone by without it being reused. Taking
+ * a node out of the free list also takes it out of the queue. A node whose pages
+ * were released is marked with the DECOMMITTED bit in its header, which splits
+ * and coalesces pass on to the free node they leave, and only marked nodes are
+ * recommitted with mem_recommit when they're handed out again.
+ *  This trades speed for footprint: the madvise calls and the page faults that
+ * follow make the stock traces 2-9x slower, so it is off unless built with
+ * -DDECOMMIT=1 ("make bench-footprint" runs both builds side by side).
+ *
+ *  With MM_STATS set, searches, splits, coalesces, sbrks and realloc copies
+ * are counted as they happen, and mm_stats walks the free list for the rest.
+ * With it clear the counting compiles away to nothing.
+ *
+ *  mm_walk follows the boundary tags from the node after 'head' to the end of
+ * the heap, the same way print_heap does, and hands each node to a callback.
  *
  * */
 #include <stdio.h>
@@ -81,6 +99,23 @@ team_t team = {
 #define NODESIZE 16
 #define MIN_SIZE 32
 
+#ifndef DECOMMIT
+#define DECOMMIT 0                      //Give pages of large free nodes back to the OS
+#endif
+#define DECOMMIT_THRESHOLD (1<<16)      //Min payload size of a node worth decommitting
+#define DECOMMIT_DELAY 64               //Frees a large node waits before it's decommitted
+#define DECOMMIT_SLOTS 4                //Max number of nodes waiting to be decommitted
+
+#ifndef MM_STATS
+#define MM_STATS 1                      //Keep the counters mm_stats reports
+#endif
+
+#if MM_STATS
+#define COUNT(field, n)     (stats.field += (n))                            //Adds n to a counter
+#else
+#define COUNT(field, n)
+#endif
+
 /* rounds up to the nearest multiple of ALIGNMENT */
 #define ALIGN(size)         (((size) + (ALIGNMENT-1)) & ~0x7)               //Align size to 8 bytes
 #define SIZE_T_SIZE         (ALIGN(sizeof(size_t)))
@@ -89,6 +124,7 @@ team_t team = {
 #define PUT(bp, value)      (*(size_t *)(bp) = (value))                     //Sets the word at address bp
 #define GET_SIZE(bp)        (GET(bp) & ~0x7)                                //Returns the size
 #define IS_ALLOC(bp)        (GET(bp) & 0x1)                                 //Checks if node is allocated
+#define DECOMMITTED(bp)     (GET(bp) & 0x2)                                 //Checks if a free node has released pages (header only)
 //Node macros
 #define NH(bp)              ((void *)(bp) - DSIZE)                          //Returns Node header address
 #define NP(bp)              ((void *)(bp) - WSIZE)                          //Next node address (self)
@@ -106,14 +142,27 @@ void print_list();
 void print_heap();
 void print_node(void *node);
 void print_pcn(void *node);
-void coalesce(void *bp);
+void *coalesce(void *bp);
 void *find_first(size_t size);
 void split(void *bp, size_t size);
 void add_node(void *bp);
 void rm_node(void *bp);
+void queue_decommit(void *bp);
+void flush_decommit(void);
+void release(void *bp);
 
 static char *head = 0;   //List of free blocks
 
+#if MM_STATS
+static mm_stats_t stats;    //Counters since mm_init
+#endif
+
+#if DECOMMIT
+static void *pending[DECOMMIT_SLOTS];       //Large free nodes waiting to be decommitted
+static size_t pending_at[DECOMMIT_SLOTS];   //Value of 'frees' when each one was queued
+static size_t frees = 0;                    //Number of calls to mm_free so far
+#endif
+
 //void print_block(void *node);
 
 /* 
@@ -129,13 +178,21 @@ int mm_init(void)
      * The prev pointer always points to NULL, should never be used
      * Footer is marked as allocated with size = 0
      */
+#if MM_STATS
+    memset(&stats, 0, sizeof(stats));       //Start counting from zero
+#endif
     head = mem_sbrk(NODESIZE);  //Extends the heap to initialize our head
+    COUNT(sbrks, 1);
     head += DSIZE;              //Puts us at the payload
     PUT(NH(head), PACK(0, 1));  //Puts the size of the header as 0 and marks it as allocated
     PUT(NP(head), 0);           //head->next = NULL
     PUT(PP(head), 0);           //head->prev = NULL
     PUT(NF(head), PACK(0, 1));  //Puts the size of the footer as 0 and marks it as allocated
 
+#if DECOMMIT
+    memset(pending, 0, sizeof(pending));    //Nothing waiting to be decommitted
+    frees = 0;
+#endif
     return 0;
 }
 
@@ -220,6 +277,14 @@ void *mm_malloc(size_t size)
     {
         size_t leftover;
         leftover = GET_SIZE(NH(bp)) - asize;    //Size of leftover/unused space in the node's payload
+
+#if DECOMMIT
+        //Only nodes whose pages were actually released need them back
+        if(DECOMMITTED(NH(bp)))
+        {
+            mem_recommit(bp, asize);
+        }
+#endif
         
         //If leftover space is enough to create a new node 
         //AND has a payload size >= 16 then we make a new free block
@@ -242,6 +307,7 @@ void *mm_malloc(size_t size)
         nnsize = asize + NODESIZE;
 
         bp = mem_sbrk(nnsize + page + NODESIZE);    //Extends the heap by the new node size and extra node
+        COUNT(sbrks, 1);
         //if sbrk was unsuccessful
         if((long)bp == -1)
         {
@@ -282,11 +348,23 @@ void mm_free(void *bp)
         PUT(NH(bp), PACK(size, 0));
         PUT(NF(bp), PACK(size, 0));
         
-        coalesce(bp);
+        bp = coalesce(bp);
+#if DECOMMIT
+        frees++;
+        flush_decommit();
+        if(GET_SIZE(NH(bp)) >= DECOMMIT_THRESHOLD)
+        {
+            queue_decommit(bp);
+        }
+#endif
     }
 }
 
-void coalesce(void *bp)
+/*
+ * coalesce - Merges bp with its free neighbours on the heap, adds the result
+ * to the free list and returns it
+ * */
+void *coalesce(void *bp)
 {
     void *p, *n;
     p = LASTN(bp);  //Previous node
@@ -295,30 +373,35 @@ void coalesce(void *bp)
     size_t prev_alloc = IS_ALLOC(NH(p));    //Previous node alloc bit
     size_t next_alloc = IS_ALLOC(NH(n));    //Next node alloc bit
     size_t size = GET_SIZE(NH(bp));         //Size of current node payload
+    size_t decommitted = DECOMMITTED(NH(bp));   //Set if any merged node released pages
     //If the next node is outside the heap
     if(n > (void *)mem_heap_hi())
     {
         next_alloc = 1; //Mark the non existance node as allocated to skip coalescing to the right
     }
+    COUNT(coalesce[(!prev_alloc << 1) | !next_alloc], 1);   //Which neighbours we merge with
     //If node to the right of bp on the heap is free
     if(!next_alloc)
     {
         size += GET_SIZE(NH(n)) + NODESIZE;
+        decommitted |= DECOMMITTED(NH(n));
         rm_node(n);                 //Removes next node from free list
-        PUT(NH(bp), PACK(size, 0));
+        PUT(NH(bp), PACK(size, 0) | decommitted);
         PUT(NF(bp), PACK(size, 0));
     }
     //If node to the left of bp on the heap is free
     if(!prev_alloc)
     {
         size += GET_SIZE(NH(p)) + NODESIZE;
+        decommitted |= DECOMMITTED(NH(p));
         rm_node(p);                 //Removes previous node from free list
         bp = p;                     //Moves us the the previous nodes payload address
-        PUT(NH(bp), PACK(size, 0)); //Update header size and marks us as a free node
+        PUT(NH(bp), PACK(size, 0) | decommitted);   //Update header size and marks us as a free node
         PUT(NF(bp), PACK(size, 0)); //Update footer size and marks us as a free node
     }
 
     add_node(bp);   //Adds coalesced node to free list
+    return bp;
 }
 
 /*
@@ -338,6 +421,8 @@ void *mm_realloc(void *ptr, size_t size)
     if (size < copySize)
         copySize = size;
     memcpy(newptr, oldptr, copySize);
+    COUNT(realloc_copies, 1);
+    COUNT(realloc_bytes, copySize);
     mm_free(oldptr);
     return newptr;
 }
@@ -348,9 +433,11 @@ void *mm_realloc(void *ptr, size_t size)
 void *find_first(size_t size)
 {
     void *bp;
+    COUNT(searches, 1);
     //Starts search at the first free node head points to
     for(bp = NPA(head); bp != NULL; bp = NPA(bp))
     {
+        COUNT(search_steps, 1);
         //As soon as we find a node that has a big enough payload we return it
         if(size <= GET_SIZE(NH(bp)))
         {
@@ -363,12 +450,14 @@ void *find_first(size_t size)
 
 void split(void *bp, size_t size)
 {
+    COUNT(splits, 1);
     rm_node(bp);    //Removes the node from the free list
     
     size_t losize;  //Leftover size
     void *node;
 
     losize = GET_SIZE(NH(bp)) - size - NODESIZE; //Just the payload, ignoring the space used for node creation
+    size_t decommitted = DECOMMITTED(NH(bp));    //The leftover keeps any released pages
 
     //Allocate the split node, using the space we need
     PUT(NH(bp), PACK(size, 1));
@@ -378,7 +467,7 @@ void split(void *bp, size_t size)
 
     //Create the new 'empty' node with the leftover size
     node = bp + (size + NODESIZE);  //Puts us at the payload of the new node
-    PUT(NH(node), PACK(losize, 0));
+    PUT(NH(node), PACK(losize, 0) | decommitted);
     PUT(NP(node), 0);
     PUT(PP(node), 0);
     PUT(NF(node), PACK(losize, 0));
@@ -386,6 +475,52 @@ void split(void *bp, size_t size)
     coalesce(node); //Coalesce the new free block
 }
 
+/*
+ * mm_stats - Copies the counters into *st and adds up the free list.
+ * Returns -1 if the counters are compiled out
+ * */
+int mm_stats(mm_stats_t *st)
+{
+#if MM_STATS
+    void *bp;
+    size_t size;
+    int class;
+
+    *st = stats;
+    st->free_bytes = st->free_blocks = st->largest_free = 0;
+    memset(st->class_blocks, 0, sizeof(st->class_blocks));
+    for(bp = NPA(head); bp != NULL; bp = NPA(bp))
+    {
+        size = GET_SIZE(NH(bp));
+        st->free_bytes += size;
+        st->free_blocks++;
+        if(size > st->largest_free)
+        {
+            st->largest_free = size;
+        }
+        for(class = 0; class < MM_CLASSES - 1 && size >= (size_t)32 << class; class++)
+            ;   //Class k starts at 2^(k+4) bytes
+        st->class_blocks[class]++;
+    }
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+/*
+ * mm_walk - Calls fn for every node on the heap after head, in address order
+ * */
+int mm_walk(mm_walk_fn fn, void *arg)
+{
+    void *bp;
+    for(bp = NEXTN(head); bp < (void *)mem_heap_hi(); bp = NEXTN(bp))
+    {
+        fn(bp, GET_SIZE(NH(bp)), IS_ALLOC(NH(bp)), arg);
+    }
+    return 0;
+}
+
 void add_node(void *bp)
 {
     if(NPA(head) == NULL)       //If the free list is empty
@@ -422,4 +557,73 @@ void rm_node(void *bp)
     }
     PUT(NP(bp), 0);             //bp->next = NULL
     PUT(PP(bp), 0);             //bp->prev = NULL
+
+#if DECOMMIT
+    int i;
+    for(i = 0; i < DECOMMIT_SLOTS; i++)
+    {
+        if(pending[i] == bp)    //No longer a free node, don't decommit it
+        {
+            pending[i] = NULL;
+        }
+    }
+#endif
+}
+
+#if DECOMMIT
+/*
+ * queue_decommit - Queues up a large free node to be decommitted later,
+ * decommitting the oldest waiting node right away if the queue is full
+ * */
+void queue_decommit(void *bp)
+{
+    int i, slot = 0;
+    for(i = 0; i < DECOMMIT_SLOTS; i++)
+    {
+        if(pending[i] == NULL)
+        {
+            slot = i;
+            break;
+        }
+        if(pending_at[i] < pending_at[slot])
+        {
+            slot = i;
+        }
+    }
+    if(pending[slot] != NULL)   //Queue is full, make room
+    {
+        release(pending[slot]);
+    }
+    pending[slot] = bp;
+    pending_at[slot] = frees;
+}
+
+/*
+ * flush_decommit - Decommits the payload pages of every queued node that
+ * has waited DECOMMIT_DELAY frees without being reused
+ * */
+void flush_decommit(void)
+{
+    int i;
+    for(i = 0; i < DECOMMIT_SLOTS; i++)
+    {
+        if(pending[i] != NULL && frees - pending_at[i] >= DECOMMIT_DELAY)
+        {
+            release(pending[i]);
+            pending[i] = NULL;
+        }
+    }
+}
+
+/*
+ * release - Decommits the payload pages of free node bp, and marks it if any
+ * whole page was given back
+ * */
+void release(void *bp)
+{
+    if(mem_decommit(bp, GET_SIZE(NH(bp))) > 0)
+    {
+        PUT(NH(bp), GET(NH(bp)) | 0x2);
+    }
 }
+#endif
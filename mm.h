@@ -1,3 +1,6 @@
+#ifndef __MM_H_
+#define __MM_H_
+
 #include <stdio.h>
 
 extern int mm_init (void);
@@ -5,6 +8,44 @@ extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
 extern void *mm_realloc(void *ptr, size_t size);
 
+/*
+ * What a package has done since mm_init, and the state of its free
+ * blocks, for mdriver -s. Free blocks are counted by size class: class
+ * k holds payloads of 2^(k+4) up to 2^(k+5)-1 bytes, except that class
+ * 0 also holds all smaller ones and the last class all larger ones.
+ * Packages that keep these define mm_stats, which returns 0 once it has
+ * filled in *stats, or -1 if the counters were compiled out.
+ */
+#define MM_CLASSES 16
+
+typedef struct {
+    unsigned long searches;       /* free list searches */
+    unsigned long search_steps;   /* free blocks looked at by them */
+    unsigned long splits;         /* free blocks split to fit a request */
+    unsigned long coalesce[4];    /* blocks freed with neither, only the
+				     next, only the previous and both
+				     neighbours free */
+    unsigned long sbrks;          /* mem_sbrk calls */
+    unsigned long realloc_copies; /* reallocs that moved the payload... */
+    unsigned long realloc_bytes;  /* ... and the bytes they copied */
+    size_t free_bytes;            /* payload bytes in free blocks */
+    size_t free_blocks;           /* free blocks */
+    size_t largest_free;          /* payload of the largest free block */
+    size_t class_blocks[MM_CLASSES]; /* free blocks in each size class */
+} mm_stats_t;
+
+extern int mm_stats(mm_stats_t *stats);
+
+/*
+ * Every block in the heap, allocated or free, in address order, for
+ * mdriver --snapshot. Packages that can walk their heap define mm_walk,
+ * which calls fn with the payload address and size of each block, and
+ * whether it is allocated, and returns 0, or -1 if it can't walk it.
+ */
+typedef void (*mm_walk_fn)(void *payload, size_t size, int alloc, void *arg);
+
+extern int mm_walk(mm_walk_fn fn, void *arg);
+
 
 /* 
  * Students work in teams of one or two.  Teams enter their team name, 
@@ -23,3 +64,4 @@ typedef struct {
 
 extern team_t team;
 
+#endif /* __MM_H_ */
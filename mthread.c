@@ -0,0 +1,188 @@
+/*
+ * mthread.c - replaying a trace on several threads at once for
+ *     "mdriver -T"
+ *
+ * Every thread replays its own copy of the trace (its own blocks
+ * array, the requests themselves are shared and only read), so the
+ * threads never touch each other's blocks and only contend inside the
+ * allocator. They are all created and set up before any of them starts,
+ * and are then let go at once. A replay is repeated MT_RUNS times and
+ * the fastest one kept, as with the other timers.
+ */
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "mthread.h"
+
+#define MT_RUNS 3  /* replays to take the fastest of */
+
+/* What each thread is given, and what it reports */
+typedef struct {
+    pthread_t tid;
+    trace_t *trace;
+    mt_alloc_t *alloc;
+    char **blocks;          /* this thread's copy of trace->blocks */
+    double secs;            /* how long its replay took */
+    int failed;             /* did the allocator run out of memory? */
+} mt_thread_t;
+
+/* The gate the threads wait at until they can all start */
+static pthread_mutex_t gate_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gate_cond = PTHREAD_COND_INITIALIZER;
+static int ready;           /* threads waiting at the gate */
+static int go;              /* has the gate opened? */
+
+/* function prototypes */
+static int replay_once(trace_t *trace, mt_alloc_t *alloc, int threads,
+		       mt_thread_t *t, double *secs);
+static void *replay_thread(void *arg);
+static double now(void);
+
+/*
+ * mt_replay - replay a copy of trace on each of threads threads at once
+ *     and fill in *res with the fastest of MT_RUNS such replays. Returns
+ *     0 if the allocator ran out of memory or the threads couldn't be
+ *     created.
+ */
+int mt_replay(trace_t *trace, mt_alloc_t *alloc, int threads,
+	      mt_result_t *res)
+{
+    mt_thread_t *t;
+    double secs, total;
+    int i, run, ok = 1;
+
+    if (threads < 1 || threads > MT_MAX_THREADS)
+	return 0;
+    if ((t = (mt_thread_t *)calloc(threads, sizeof(mt_thread_t))) == NULL)
+	return 0;
+    for (i = 0; i < threads; i++) {
+	t[i].trace = trace;
+	t[i].alloc = alloc;
+	t[i].blocks = (char **)calloc(trace->num_ids + 1, sizeof(char *));
+	if (t[i].blocks == NULL)
+	    ok = 0;
+    }
+
+    res->threads = threads;
+    res->secs = -1;
+    for (run = 0; ok && run < MT_RUNS; run++) {
+	if (!replay_once(trace, alloc, threads, t, &secs)) {
+	    ok = 0;
+	    break;
+	}
+	if (res->secs < 0 || secs < res->secs) {
+	    res->secs = secs;
+	    for (total = 0, i = 0; i < threads; i++)
+		total += t[i].secs;
+	    res->thread_secs = total / threads;
+	}
+    }
+
+    for (i = 0; i < threads; i++)
+	free(t[i].blocks);
+    free(t);
+    return ok;
+}
+
+/*
+ * The remaining routines are internal helper routines
+ */
+
+/*
+ * replay_once - run the threads once, setting *secs to the time from
+ *     opening the gate to the last thread finishing. Returns 0 on failure.
+ */
+static int replay_once(trace_t *trace, mt_alloc_t *alloc, int threads,
+		       mt_thread_t *t, double *secs)
+{
+    int i, created, ok = 1;
+    double start;
+
+    if (alloc->init != NULL && alloc->init() < 0)
+	return 0;
+
+    ready = go = 0;
+    for (created = 0; created < threads; created++) {
+	t[created].failed = 0;
+	if (pthread_create(&t[created].tid, NULL, replay_thread,
+			   &t[created]) != 0) {
+	    ok = 0;
+	    break;
+	}
+    }
+
+    /* Let them all go once they are all waiting */
+    pthread_mutex_lock(&gate_lock);
+    while (ready < created)
+	pthread_cond_wait(&gate_cond, &gate_lock);
+    go = 1;
+    start = now();
+    pthread_cond_broadcast(&gate_cond);
+    pthread_mutex_unlock(&gate_lock);
+
+    for (i = 0; i < created; i++) {
+	pthread_join(t[i].tid, NULL);
+	if (t[i].failed)
+	    ok = 0;
+    }
+    *secs = now() - start;
+    return ok;
+}
+
+/*
+ * replay_thread - wait at the gate, then replay the trace into this
+ *     thread's blocks array, stopping if the allocator returns NULL
+ */
+static void *replay_thread(void *arg)
+{
+    mt_thread_t *t = (mt_thread_t *)arg;
+    trace_t *trace = t->trace;
+    mt_alloc_t *alloc = t->alloc;
+    char **blocks = t->blocks;
+    traceop_t *op;
+    char *p;
+    double start;
+    int i;
+
+    if (alloc->attach != NULL)
+	alloc->attach();
+    pthread_mutex_lock(&gate_lock);
+    ready++;
+    pthread_cond_broadcast(&gate_cond);
+    while (!go)
+	pthread_cond_wait(&gate_cond, &gate_lock);
+    pthread_mutex_unlock(&gate_lock);
+
+    start = now();
+    for (i = 0; i < trace->num_ops; i++) {
+	op = &trace->ops[i];
+	switch (op->type) {
+	case ALLOC:
+	    p = alloc->malloc(op->size);
+	    break;
+	case REALLOC:
+	    p = alloc->realloc(blocks[op->index], op->size);
+	    break;
+	default: /* FREE */
+	    alloc->free(blocks[op->index]);
+	    continue;
+	}
+	if (p == NULL) {
+	    t->failed = 1;
+	    break;
+	}
+	blocks[op->index] = p;
+    }
+    t->secs = now() - start;
+    return NULL;
+}
+
+/* now - read the monotonic clock, in seconds */
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9*ts.tv_nsec;
+}
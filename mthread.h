@@ -0,0 +1,33 @@
+/*
+ * mthread.h - replaying a trace on several threads at once for
+ *     "mdriver -T"
+ */
+#ifndef __MTHREAD_H_
+#define __MTHREAD_H_
+
+#include "trace.h"
+
+#define MT_MAX_COUNTS  8    /* most thread counts in a -T list */
+#define MT_MAX_THREADS 256  /* most threads in a replay */
+
+/* The allocator the threads call */
+typedef struct {
+    int (*init)(void);      /* resets it before each replay; may be NULL */
+    void (*attach)(void);   /* run by each thread first; may be NULL */
+    void *(*malloc)(size_t size);
+    void (*free)(void *ptr);
+    void *(*realloc)(void *ptr, size_t size);
+} mt_alloc_t;
+
+/* How a replay went */
+typedef struct {
+    int threads;            /* threads replaying the trace */
+    double secs;            /* wall-clock secs until they had all finished */
+    double thread_secs;     /* secs each thread took, on average */
+} mt_result_t;
+
+/* Replay a copy of trace on each of threads threads at once */
+int mt_replay(trace_t *trace, mt_alloc_t *alloc, int threads,
+	      mt_result_t *res);
+
+#endif /* __MTHREAD_H_ */
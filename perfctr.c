@@ -0,0 +1,121 @@
+/*
+ * perfctr.c - hardware performance counters for "mdriver -c"
+ *
+ * Each event is counted by its own perf_event_open counter on the
+ * calling process, in user mode only (which is all that unprivileged
+ * users are usually allowed, and all that the allocator runs in).
+ * Events the CPU or kernel doesn't support are skipped. If the kernel
+ * has to multiplex the counters, the counts are scaled up by the share
+ * of the time each counter was actually running.
+ *
+ * Counters belong to the process that opened them, so a forked -j
+ * worker opens its own the first time it calls pc_start.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "perfctr.h"
+
+/* How to ask for a cache event */
+#define CACHE_MISS(cache) ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | \
+			   (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static struct {
+    char *name;
+    unsigned type;
+    unsigned long long config;
+} events[PC_EVENTS] = {
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"insns", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"L1D miss", PERF_TYPE_HW_CACHE, CACHE_MISS(PERF_COUNT_HW_CACHE_L1D)},
+    {"LLC miss", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {"dTLB miss", PERF_TYPE_HW_CACHE, CACHE_MISS(PERF_COUNT_HW_CACHE_DTLB)},
+    {"br miss", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+static int fds[PC_EVENTS] = {-1, -1, -1, -1, -1, -1};
+static pid_t owner = 0;     /* the process the counters count */
+
+/*
+ * pc_open - open a counter for each event in this process, closing any
+ *     inherited from a parent. Returns the number opened; if it is 0,
+ *     why (of len bytes) says what went wrong.
+ */
+int pc_open(char *why, int len)
+{
+    struct perf_event_attr attr;
+    int i, n = 0, err = 0;
+
+    for (i = 0; i < PC_EVENTS; i++) {
+	if (fds[i] >= 0)
+	    close(fds[i]);
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = events[i].type;
+	attr.config = events[i].config;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+	    PERF_FORMAT_TOTAL_TIME_RUNNING;
+	fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+	if (fds[i] >= 0)
+	    n++;
+	else if (err == 0)
+	    err = errno;
+    }
+    owner = getpid();
+    if (n == 0 && why != NULL)
+	snprintf(why, len, "perf_event_open: %s", strerror(err));
+    return n;
+}
+
+/*
+ * pc_start - zero the counters and start them
+ */
+void pc_start(void)
+{
+    int i;
+
+    if (owner != getpid())
+	pc_open(NULL, 0);
+    for (i = 0; i < PC_EVENTS; i++) {
+	if (fds[i] >= 0) {
+	    ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+	    ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+	}
+    }
+}
+
+/*
+ * pc_stop - stop the counters and read them into *c
+ */
+void pc_stop(pc_counts_t *c)
+{
+    unsigned long long v[3]; /* value, time enabled, time running */
+    int i;
+
+    for (i = 0; i < PC_EVENTS; i++)
+	if (fds[i] >= 0)
+	    ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+    for (i = 0; i < PC_EVENTS; i++) {
+	c->count[i] = -1;
+	if (fds[i] < 0 || read(fds[i], v, sizeof(v)) != sizeof(v) ||
+	    v[2] == 0)
+	    continue;
+	c->count[i] = (double)v[0] * v[1] / v[2];
+    }
+}
+
+/*
+ * pc_name - returns the short name of an event
+ */
+char *pc_name(int event)
+{
+    return events[event].name;
+}
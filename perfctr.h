@@ -0,0 +1,33 @@
+/*
+ * perfctr.h - hardware performance counters for "mdriver -c"
+ */
+#ifndef __PERFCTR_H_
+#define __PERFCTR_H_
+
+/* The events counted */
+#define PC_CYCLES        0
+#define PC_INSTRUCTIONS  1
+#define PC_L1D_MISSES    2   /* L1 data cache read misses */
+#define PC_LLC_MISSES    3   /* last level cache misses */
+#define PC_DTLB_MISSES   4   /* data TLB read misses */
+#define PC_BRANCH_MISSES 5
+#define PC_EVENTS        6
+
+/* Counts of each event; negative if the event couldn't be counted */
+typedef struct {
+    double count[PC_EVENTS];
+} pc_counts_t;
+
+/* Open the counters; returns how many could be opened */
+int pc_open(char *why, int len);
+
+/* Start counting from zero */
+void pc_start(void);
+
+/* Stop counting and read the counts */
+void pc_stop(pc_counts_t *c);
+
+/* Short name of an event */
+char *pc_name(int event);
+
+#endif /* __PERFCTR_H_ */
@@ -0,0 +1,376 @@
+/*
+ * snapview.c - analyse the heap snapshots written by "mdriver --snapshot"
+ *
+ * Usage: snapview [-o <op>] [-w <cols>] [-r <rows>] <file.snap>
+ *
+ * For each snapshot in the file (or only the one taken after <op>
+ * requests) it prints
+ *
+ *   - where the heap's bytes went: live payload, slack at the end of
+ *     allocated payloads, free blocks and the allocator's overhead
+ *   - a map of the heap, one character per cell, showing how much of
+ *     each cell is allocated payload
+ *   - histograms of allocated and free block sizes, by powers of two
+ *   - how free blocks are interleaved with allocated ones: the runs of
+ *     each in address order, free blocks with allocated ones on both
+ *     sides, and free blocks right after free blocks (which a coalescing
+ *     allocator shouldn't leave)
+ *   - external fragmentation: 1 - the largest free block over all free
+ *     bytes, and for a few request sizes, the share of the free bytes in
+ *     blocks too small to hold one
+ *
+ * Blocks are read one at a time, so a snapshot of a heap of any size is
+ * analysed in memory proportional to the map.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "heapsnap.h"
+
+#define NCLASSES    64     /* power of two size classes */
+#define NFITS       6      /* request sizes fragmentation is measured at */
+
+/* The request sizes fragmentation is measured at */
+static unsigned long long fit_sizes[NFITS] =
+    {64, 256, 1 << 10, 4 << 10, 16 << 10, 64 << 10};
+
+static int map_cols = 64;   /* cells per line of the heap map (-w) */
+static int map_rows = 16;   /* lines of it (-r) */
+
+/* What is learnt about one snapshot; [0] is free, [1] allocated */
+typedef struct {
+    unsigned long long blocks[2];      /* blocks... */
+    unsigned long long bytes[2];       /* ... and their payload bytes */
+    unsigned long long class_blocks[2][NCLASSES]; /* by size class */
+    unsigned long long class_bytes[2][NCLASSES];
+    unsigned long long runs[2];        /* runs of blocks of each kind */
+    unsigned long long holes;          /* free blocks between allocated */
+    unsigned long long free_pairs;     /* free blocks after free blocks */
+    unsigned long long largest_free;   /* payload of the largest one */
+    unsigned long long too_small[NFITS]; /* free bytes in blocks smaller
+					    than each fit size */
+    unsigned long long overlaps;       /* blocks that start before the
+					  one before them ends */
+    unsigned long long cell_bytes;     /* heap bytes per map cell */
+    unsigned long long *cells;         /* allocated bytes in each cell */
+    int ncells;                        /* cells covering the heap */
+} view_t;
+
+/* function prototypes */
+static int read_snapshot(FILE *fp, snap_hdr_t *hdr, view_t *v);
+static void add_to_map(view_t *v, unsigned long long lo,
+		       unsigned long long hi, unsigned long long heap_bytes);
+static void print_snapshot(snap_hdr_t *hdr, view_t *v, char *path);
+static void print_map(snap_hdr_t *hdr, view_t *v);
+static void print_classes(view_t *v);
+static char *size_str(unsigned long long bytes, char *buf);
+static double pct(unsigned long long part, unsigned long long whole);
+static void usage(void);
+
+int main(int argc, char **argv)
+{
+    snap_hdr_t hdr;
+    view_t v;
+    FILE *fp;
+    long long only = -1;
+    int c, found = 0;
+
+    while ((c = getopt(argc, argv, "o:w:r:h")) != EOF) {
+	switch (c) {
+	case 'o':
+	    only = atoll(optarg);
+	    break;
+	case 'w':
+	    map_cols = atoi(optarg);
+	    break;
+	case 'r':
+	    map_rows = atoi(optarg);
+	    break;
+	default:
+	    usage();
+	    exit(c != 'h');
+	}
+    }
+    if (optind != argc - 1 || only < -1 || map_cols < 1 || map_rows < 0) {
+	usage();
+	exit(1);
+    }
+    if ((fp = snap_open(argv[optind])) == NULL) {
+	fprintf(stderr, "%s is not a heap snapshot file\n", argv[optind]);
+	exit(1);
+    }
+
+    v.cells = NULL;
+    while (snap_next(fp, &hdr)) {
+	if (only >= 0 && hdr.op != (unsigned long long)only) {
+	    if (!snap_skip(fp, &hdr))
+		break;
+	    continue;
+	}
+	if (!read_snapshot(fp, &hdr, &v)) {
+	    fprintf(stderr, "%s: the snapshot after %llu requests is cut "
+		    "short\n", argv[optind], hdr.op);
+	    exit(1);
+	}
+	if (found++)
+	    printf("\n");
+	print_snapshot(&hdr, &v, argv[optind]);
+    }
+    if (only >= 0 && !found) {
+	fprintf(stderr, "%s has no snapshot after %lld requests\n",
+		argv[optind], only);
+	exit(1);
+    }
+    free(v.cells);
+    fclose(fp);
+    exit(0);
+}
+
+/*
+ * read_snapshot - read the blocks of the snapshot whose header is hdr,
+ *     adding them up in v. Returns 0 if the file ends first.
+ */
+static int read_snapshot(FILE *fp, snap_hdr_t *hdr, view_t *v)
+{
+    unsigned long long n, end = 0, size;
+    snap_block_t blk;
+    int k, class, prev = -1, prev2 = -1;
+    unsigned long long *cells = v->cells;
+
+    memset(v, 0, sizeof(view_t));
+    v->ncells = map_cols * map_rows;
+    if (v->ncells > 0 && hdr->heap_bytes > 0) {
+	v->cell_bytes = (hdr->heap_bytes + v->ncells - 1) / v->ncells;
+	v->ncells = (int)((hdr->heap_bytes + v->cell_bytes - 1) /
+			  v->cell_bytes);
+	cells = realloc(cells, v->ncells * sizeof(unsigned long long));
+	if (cells == NULL) {
+	    fprintf(stderr, "Out of memory for the heap map\n");
+	    exit(1);
+	}
+	memset(cells, 0, v->ncells * sizeof(unsigned long long));
+    }
+    else
+	v->ncells = 0;
+    v->cells = cells;
+
+    for (n = 0; n < hdr->nblocks; n++) {
+	if (!snap_block(fp, &blk))
+	    return 0;
+	k = blk.alloc ? 1 : 0;
+	size = blk.size;
+
+	v->blocks[k]++;
+	v->bytes[k] += size;
+	for (class = 0; class < NCLASSES - 1 && size >= 2ULL << class; class++)
+	    ;   /* class k holds 2^k up to 2^(k+1)-1 bytes */
+	v->class_blocks[k][class]++;
+	v->class_bytes[k][class] += size;
+
+	if (blk.offset < end)
+	    v->overlaps++;
+	if (blk.offset + size > end)
+	    end = blk.offset + size;
+
+	/* interleaving */
+	if (k != prev)
+	    v->runs[k]++;
+	if (!k && prev == 0)
+	    v->free_pairs++;
+	if (k && prev == 0 && prev2 == 1)
+	    v->holes++;
+	prev2 = prev;
+	prev = k;
+
+	if (k)
+	    add_to_map(v, blk.offset, blk.offset + size, hdr->heap_bytes);
+	else {
+	    if (size > v->largest_free)
+		v->largest_free = size;
+	    for (class = 0; class < NFITS; class++)
+		if (size < fit_sizes[class])
+		    v->too_small[class] += size;
+	}
+    }
+    return 1;
+}
+
+/*
+ * add_to_map - count the allocated bytes lo up to hi in the map cells
+ *     they fall in
+ */
+static void add_to_map(view_t *v, unsigned long long lo,
+		       unsigned long long hi, unsigned long long heap_bytes)
+{
+    unsigned long long c, end;
+
+    if (v->ncells == 0)
+	return;
+    if (hi > heap_bytes)
+	hi = heap_bytes;
+    for (c = lo / v->cell_bytes; c < (unsigned long long)v->ncells && lo < hi;
+	 c++) {
+	end = (c + 1) * v->cell_bytes;
+	if (end > hi)
+	    end = hi;
+	v->cells[c] += end - lo;
+	lo = end;
+    }
+}
+
+/*
+ * print_snapshot - report on one snapshot
+ */
+static void print_snapshot(snap_hdr_t *hdr, view_t *v, char *path)
+{
+    unsigned long long heap = hdr->heap_bytes, payload, free_bytes;
+    char b1[32], b2[32];
+    int k;
+
+    payload = v->bytes[0] + v->bytes[1];
+    free_bytes = v->bytes[0];
+    printf("%s: after %llu requests, heap of %s at 0x%llx\n", path, hdr->op,
+	   size_str(heap, b1), hdr->heap_lo);
+    printf("  live payload   %10s %6.1f%%\n", size_str(hdr->live_bytes, b1),
+	   pct(hdr->live_bytes, heap));
+    printf("  slack          %10s %6.1f%%  (allocated payload past the "
+	   "live bytes)\n",
+	   size_str(v->bytes[1] > hdr->live_bytes ?
+		    v->bytes[1] - hdr->live_bytes : 0, b1),
+	   pct(v->bytes[1] > hdr->live_bytes ?
+	       v->bytes[1] - hdr->live_bytes : 0, heap));
+    printf("  free           %10s %6.1f%%\n", size_str(free_bytes, b1),
+	   pct(free_bytes, heap));
+    printf("  overhead       %10s %6.1f%%  (headers, footers, padding)\n",
+	   size_str(heap > payload ? heap - payload : 0, b1),
+	   pct(heap > payload ? heap - payload : 0, heap));
+    printf("  blocks         %10llu allocated, %llu free\n", v->blocks[1],
+	   v->blocks[0]);
+    if (v->overlaps)
+	printf("  WARNING: %llu blocks overlap the one before them\n",
+	       v->overlaps);
+
+    if (v->ncells > 0)
+	print_map(hdr, v);
+    if (v->blocks[0] + v->blocks[1] > 0)
+	print_classes(v);
+
+    printf("\n  Interleaving\n");
+    printf("    runs of allocated blocks %10llu (%.1f blocks each)\n",
+	   v->runs[1], v->runs[1] ? (double)v->blocks[1] / v->runs[1] : 0.0);
+    printf("    runs of free blocks      %10llu (%.1f blocks each)\n",
+	   v->runs[0], v->runs[0] ? (double)v->blocks[0] / v->runs[0] : 0.0);
+    printf("    free between allocated   %10llu (%.1f%% of free blocks)\n",
+	   v->holes, pct(v->holes, v->blocks[0]));
+    printf("    free after free          %10llu (missed coalesces)\n",
+	   v->free_pairs);
+
+    printf("\n  External fragmentation\n");
+    printf("    1 - largest/free bytes   %10.3f (largest free %s)\n",
+	   free_bytes ? 1.0 - (double)v->largest_free / free_bytes : 0.0,
+	   size_str(v->largest_free, b1));
+    for (k = 0; k < NFITS; k++)
+	printf("    unusable for %-6s      %9.1f%% (%s in smaller blocks)\n",
+	       size_str(fit_sizes[k], b1), pct(v->too_small[k], free_bytes),
+	       size_str(v->too_small[k], b2));
+}
+
+/*
+ * print_map - draw the heap, each character a cell of cell_bytes: '#'
+ *     if at least 3/4 of it is allocated payload, '+' at least half,
+ *     '-' at least a quarter, '.' some, and ' ' none
+ */
+static void print_map(snap_hdr_t *hdr, view_t *v)
+{
+    unsigned long long lo, len;
+    double frac;
+    char buf[32];
+    int c;
+
+    printf("\n  Heap map, %s per cell (# >= 3/4 allocated, + >= 1/2, "
+	   "- >= 1/4, . > 0)\n", size_str(v->cell_bytes, buf));
+    for (c = 0; c < v->ncells; c++) {
+	lo = c * v->cell_bytes;
+	if (c % map_cols == 0)
+	    printf("    %8s |", size_str(lo, buf));
+	len = hdr->heap_bytes - lo < v->cell_bytes ?
+	    hdr->heap_bytes - lo : v->cell_bytes;
+	frac = (double)v->cells[c] / len;
+	putchar(frac >= 0.75 ? '#' : frac >= 0.5 ? '+' : frac >= 0.25 ? '-' :
+		frac > 0 ? '.' : ' ');
+	if (c % map_cols == map_cols - 1 || c == v->ncells - 1)
+	    printf("|\n");
+    }
+}
+
+/*
+ * print_classes - the block size histograms, from the smallest class
+ *     with any blocks to the largest
+ */
+static void print_classes(view_t *v)
+{
+    int lo = NCLASSES, hi = 0, k;
+    char b1[32], b2[32], b3[32];
+
+    for (k = 0; k < NCLASSES; k++)
+	if (v->class_blocks[0][k] || v->class_blocks[1][k]) {
+	    if (k < lo)
+		lo = k;
+	    hi = k;
+	}
+    printf("\n  Block sizes %21s %21s\n", "allocated", "free");
+    printf("    %-8s%10s%8s%8s%10s%8s%8s\n", "size", "blocks", "bytes", "%",
+	   "blocks", "bytes", "%");
+    for (k = lo; k <= hi; k++) {
+	sprintf(b3, "%s+", size_str(1ULL << k, b1));
+	printf("    %-8s%10llu%8s%7.1f%%%10llu%8s%7.1f%%\n", b3,
+	       v->class_blocks[1][k], size_str(v->class_bytes[1][k], b1),
+	       pct(v->class_bytes[1][k], v->bytes[1]), v->class_blocks[0][k],
+	       size_str(v->class_bytes[0][k], b2),
+	       pct(v->class_bytes[0][k], v->bytes[0]));
+    }
+}
+
+/*
+ * The remaining routines are internal helper routines
+ */
+
+/* size_str - a byte count, with a K, M or G suffix if it's large */
+static char *size_str(unsigned long long bytes, char *buf)
+{
+    static char *suffix = "KMGTPE";
+    double val = bytes;
+    int k = -1;
+
+    while (val >= 1024 && suffix[k+1] != '\0') {
+	val /= 1024;
+	k++;
+    }
+    if (k < 0)
+	sprintf(buf, "%llu", bytes);
+    else if (val == (unsigned long long)val)
+	sprintf(buf, "%.0f%c", val, suffix[k]);
+    else
+	sprintf(buf, "%.1f%c", val, suffix[k]);
+    return buf;
+}
+
+/* pct - part as a percentage of whole */
+static double pct(unsigned long long part, unsigned long long whole)
+{
+    return whole ? 100.0 * part / whole : 0.0;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: snapview [-o <op>] [-w <cols>] [-r <rows>] "
+	    "<file.snap>\n");
+    fprintf(stderr, "\t-o <op>     Only the snapshot taken after <op> "
+	    "requests.\n");
+    fprintf(stderr, "\t-w <cols>   Cells per line of the heap map "
+	    "(default 64).\n");
+    fprintf(stderr, "\t-r <rows>   Lines of the heap map, 0 for none "
+	    "(default 16).\n");
+}
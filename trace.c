@@ -0,0 +1,480 @@
+/*
+ * trace.c - read malloc lab trace files into memory
+ *
+ * A trace file has four header lines (suggested heap size, number of
+ * block ids, number of requests, weight) followed by one request per
+ * line: "a <id> <size>", "r <id> <size>" or "f <id>".
+ *
+ * Files ending in TRACE_BIN_EXT hold the same information in the compact
+ * binary format described in trace.h.
+ *
+ * read_trace maps the file and parses the integers directly out of the
+ * mapped bytes, which is much faster than stdio on large traces.
+ * read_trace_stdio is the original fscanf-based reader (text only).
+ * write_trace writes a trace in either format.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "trace.h"
+
+#define MAXLINE     1024 /* max string size */
+
+/* Map signed id deltas to unsigned varints and back */
+#define ZIGZAG(v)    ((((unsigned long long)(v)) << 1) ^ (unsigned long long)((v) >> 63))
+#define UNZIGZAG(u)  ((long long)((u) >> 1) ^ -(long long)((u) & 1))
+
+extern int verbose; /* -v option in mdriver.c */
+
+/* function prototypes */
+static trace_t *alloc_trace(int num_ids, int num_ops);
+static trace_t *parse_text(char *p, char *end, char *path);
+static trace_t *parse_binary(char *p, char *end, char *path);
+static int parse_int(char **pp, char *end, long *val);
+static int get_varint(unsigned char **pp, unsigned char *end, 
+		      unsigned long long *val);
+static void put_varint(FILE *fp, unsigned long long val);
+static void trace_error(char *fmt, char *path);
+static void unix_error(char *msg);
+
+/*
+ * read_trace - read a trace file and store it in memory
+ */
+trace_t *read_trace(char *tracedir, char *filename)
+{
+    trace_t *trace;
+    char path[MAXLINE];
+    char msg[2*MAXLINE];
+    struct stat st;
+    int fd;
+    char *buf;
+
+    if (verbose > 1)
+	printf("Reading tracefile: %s\n", filename);
+
+    /* Map the whole trace file */
+    strcpy(path, tracedir);
+    strcat(path, filename);
+    if ((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &st) < 0) {
+	sprintf(msg, "Could not open %s in read_trace", path);
+	unix_error(msg);
+    }
+    if (st.st_size == 0)
+	trace_error("Tracefile %s is empty", path);
+    buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (buf == MAP_FAILED) {
+	sprintf(msg, "Could not map %s in read_trace", path);
+	unix_error(msg);
+    }
+    close(fd);
+    madvise(buf, st.st_size, MADV_SEQUENTIAL);
+
+    if (is_binary_trace(path))
+	trace = parse_binary(buf, buf + st.st_size, path);
+    else
+	trace = parse_text(buf, buf + st.st_size, path);
+    munmap(buf, st.st_size);
+    return trace;
+}
+
+/*
+ * read_trace_stdio - read a trace file and store it in memory, parsing
+ *     it with fscanf
+ */
+trace_t *read_trace_stdio(char *tracedir, char *filename)
+{
+    FILE *tracefile;
+    trace_t *trace;
+    char type[MAXLINE];
+    char path[MAXLINE];
+    char msg[2*MAXLINE];
+    int sugg_heapsize, num_ids, num_ops, weight;
+    unsigned index, size;
+    unsigned max_index = 0;
+    unsigned op_index;
+
+    if (verbose > 1)
+	printf("Reading tracefile: %s\n", filename);
+
+    /* Read the trace file header */
+    strcpy(path, tracedir);
+    strcat(path, filename);
+    if ((tracefile = fopen(path, "r")) == NULL) {
+	sprintf(msg, "Could not open %s in read_trace", path);
+	unix_error(msg);
+    }
+    fscanf(tracefile, "%d", &sugg_heapsize); /* not used */
+    fscanf(tracefile, "%d", &num_ids);     
+    fscanf(tracefile, "%d", &num_ops);     
+    fscanf(tracefile, "%d", &weight);        /* not used */
+    trace = alloc_trace(num_ids, num_ops);
+    trace->sugg_heapsize = sugg_heapsize;
+    trace->weight = weight;
+    
+    /* read every request line in the trace file */
+    index = 0;
+    op_index = 0;
+    while (fscanf(tracefile, "%s", type) != EOF) {
+	switch(type[0]) {
+	case 'a':
+	    fscanf(tracefile, "%u %u", &index, &size);
+	    trace->ops[op_index].type = ALLOC;
+	    trace->ops[op_index].index = index;
+	    trace->ops[op_index].size = size;
+	    max_index = (index > max_index) ? index : max_index;
+	    break;
+	case 'r':
+	    fscanf(tracefile, "%u %u", &index, &size);
+	    trace->ops[op_index].type = REALLOC;
+	    trace->ops[op_index].index = index;
+	    trace->ops[op_index].size = size;
+	    max_index = (index > max_index) ? index : max_index;
+	    break;
+	case 'f':
+	    fscanf(tracefile, "%ud", &index);
+	    trace->ops[op_index].type = FREE;
+	    trace->ops[op_index].index = index;
+	    break;
+	default:
+	    printf("Bogus type character (%c) in tracefile %s\n", 
+		   type[0], path);
+	    exit(1);
+	}
+	op_index++;
+	
+    }
+    fclose(tracefile);
+    assert(max_index == trace->num_ids - 1);
+    assert(trace->num_ops == op_index);
+    
+    return trace;
+}
+
+/*
+ * free_trace - Free the trace record and the three arrays it points
+ *              to, all of which were allocated in read_trace().
+ */
+void free_trace(trace_t *trace)
+{
+    free(trace->ops);         /* free the three arrays... */
+    free(trace->blocks);      
+    free(trace->block_sizes);
+    free(trace);              /* and the trace record itself... */
+}
+
+/*
+ * write_trace - write the requests of trace to path, in binary if path
+ *     ends in TRACE_BIN_EXT and as text otherwise. Returns -1 with errno
+ *     set on error.
+ */
+int write_trace(trace_t *trace, char *path)
+{
+    FILE *fp;
+    traceop_t *op;
+    int i, prev = 0;
+    long long hdr[4];
+    unsigned char b[8];
+    int j, k;
+
+    if ((fp = fopen(path, "w")) == NULL)
+	return -1;
+
+    if (!is_binary_trace(path)) {
+	fprintf(fp, "%d\n%d\n%d\n%d\n", trace->sugg_heapsize, 
+		trace->num_ids, trace->num_ops, trace->weight);
+	for (i = 0; i < trace->num_ops; i++) {
+	    op = &trace->ops[i];
+	    if (op->type == FREE)
+		fprintf(fp, "f %d\n", op->index);
+	    else
+		fprintf(fp, "%c %d %d\n", (op->type == ALLOC) ? 'a' : 'r', 
+			op->index, op->size);
+	}
+    }
+    else {
+	/* magic, version and the four header fields (little endian) */
+	fwrite(TRACE_BIN_MAGIC, 1, 4, fp);
+	putc(TRACE_BIN_VERSION, fp);
+	putc(0, fp); putc(0, fp); putc(0, fp);
+	hdr[0] = trace->sugg_heapsize;
+	hdr[1] = trace->num_ids;
+	hdr[2] = trace->num_ops;
+	hdr[3] = trace->weight;
+	for (k = 0; k < 4; k++) {
+	    for (j = 0; j < 8; j++)
+		b[j] = (unsigned char)((unsigned long long)hdr[k] >> (8*j));
+	    fwrite(b, 1, 8, fp);
+	}
+
+	/* one type byte plus varints for the id delta and the size */
+	for (i = 0; i < trace->num_ops; i++) {
+	    op = &trace->ops[i];
+	    putc(op->type, fp);
+	    put_varint(fp, ZIGZAG((long long)op->index - prev));
+	    prev = op->index;
+	    if (op->type != FREE)
+		put_varint(fp, (unsigned)op->size);
+	}
+    }
+
+    if (ferror(fp)) {
+	fclose(fp);
+	return -1;
+    }
+    return fclose(fp);
+}
+
+/*
+ * is_binary_trace - returns true if path names a binary trace file
+ */
+int is_binary_trace(char *path)
+{
+    size_t len = strlen(path), extlen = strlen(TRACE_BIN_EXT);
+
+    return len >= extlen && !strcmp(path + len - extlen, TRACE_BIN_EXT);
+}
+
+/*
+ * The remaining routines are internal helper routines 
+ */
+
+/*
+ * parse_text - parse the text trace in [p, end) read from path
+ */
+static trace_t *parse_text(char *p, char *end, char *path)
+{
+    trace_t *trace;
+    long hdr[4], index, size;
+    long max_index = 0;
+    int op_index, i;
+    char type;
+
+    /* Read the trace file header */
+    for (i = 0; i < 4; i++)
+	if (!parse_int(&p, end, &hdr[i]))
+	    trace_error("Bad header in tracefile %s", path);
+    if (hdr[1] < 0 || hdr[2] < 0)
+	trace_error("Bad header in tracefile %s", path);
+    trace = alloc_trace(hdr[1], hdr[2]);
+    trace->sugg_heapsize = hdr[0]; /* not used */
+    trace->weight = hdr[3];        /* not used */
+
+    /* read every request line in the trace file */
+    op_index = 0;
+    for (;;) {
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+	    p++;
+	if (p == end)
+	    break;
+
+	/* the request type is the first character of the first word */
+	type = *p;
+	while (p < end && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r')
+	    p++;
+	if (op_index >= trace->num_ops)
+	    trace_error("Tracefile %s has more requests than its header says", 
+			path);
+
+	switch(type) {
+	case 'a':
+	case 'r':
+	    if (!parse_int(&p, end, &index) || !parse_int(&p, end, &size))
+		trace_error("Bad request line in tracefile %s", path);
+	    trace->ops[op_index].type = (type == 'a') ? ALLOC : REALLOC;
+	    trace->ops[op_index].index = index;
+	    trace->ops[op_index].size = size;
+	    max_index = (index > max_index) ? index : max_index;
+	    break;
+	case 'f':
+	    if (!parse_int(&p, end, &index))
+		trace_error("Bad request line in tracefile %s", path);
+	    trace->ops[op_index].type = FREE;
+	    trace->ops[op_index].index = index;
+	    break;
+	default:
+	    printf("Bogus type character (%c) in tracefile %s\n", 
+		   type, path);
+	    exit(1);
+	}
+	op_index++;
+    }
+    assert(max_index == trace->num_ids - 1);
+    assert(trace->num_ops == op_index);
+
+    return trace;
+}
+
+/*
+ * parse_binary - parse the binary trace in [p, end) read from path
+ */
+static trace_t *parse_binary(char *p, char *end, char *path)
+{
+    trace_t *trace;
+    unsigned char *q = (unsigned char *)p + TRACE_BIN_HDRSIZE;
+    unsigned char *qend = (unsigned char *)end;
+    long long hdr[4];
+    unsigned long long delta, size;
+    long long index = 0, max_index = 0;
+    int op_index, i, j;
+    traceop_t *op;
+
+    /* Read the trace file header */
+    if (end - p < TRACE_BIN_HDRSIZE || memcmp(p, TRACE_BIN_MAGIC, 4) ||
+	p[4] != TRACE_BIN_VERSION)
+	trace_error("Bad header in binary tracefile %s", path);
+    for (i = 0; i < 4; i++) {
+	unsigned char *b = (unsigned char *)p + 8 + 8*i;
+	unsigned long long v = 0;
+	for (j = 7; j >= 0; j--)
+	    v = (v << 8) | b[j];
+	hdr[i] = (long long)v;
+    }
+    if (hdr[1] < 0 || hdr[2] < 0 || hdr[1] > INT_MAX || hdr[2] > INT_MAX)
+	trace_error("Bad header in binary tracefile %s", path);
+    trace = alloc_trace(hdr[1], hdr[2]);
+    trace->sugg_heapsize = hdr[0]; /* not used */
+    trace->weight = hdr[3];        /* not used */
+
+    /* decode every request */
+    for (op_index = 0; op_index < trace->num_ops; op_index++) {
+	op = &trace->ops[op_index];
+	if (q == qend || *q > REALLOC)
+	    trace_error("Truncated or corrupt binary tracefile %s", path);
+	op->type = *q++;
+	if (!get_varint(&q, qend, &delta))
+	    trace_error("Truncated or corrupt binary tracefile %s", path);
+	index += UNZIGZAG(delta);
+	op->index = index;
+	if (op->type != FREE) {
+	    if (!get_varint(&q, qend, &size))
+		trace_error("Truncated or corrupt binary tracefile %s", path);
+	    op->size = size;
+	    max_index = (index > max_index) ? index : max_index;
+	}
+    }
+    if (q != qend)
+	trace_error("Tracefile %s has more requests than its header says", 
+		    path);
+    assert(max_index == trace->num_ids - 1);
+
+    return trace;
+}
+
+/*
+ * alloc_trace - allocate a trace record with room for num_ops requests
+ *     and num_ids blocks
+ */
+static trace_t *alloc_trace(int num_ids, int num_ops)
+{
+    trace_t *trace;
+
+    /* Allocate the trace record */
+    if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
+	unix_error("malloc 1 failed in read_trace");
+    trace->num_ids = num_ids;
+    trace->num_ops = num_ops;
+
+    /* We'll store each request line in the trace in this array */
+    if ((trace->ops = 
+	 (traceop_t *)malloc(num_ops * sizeof(traceop_t))) == NULL)
+	unix_error("malloc 2 failed in read_trace");
+
+    /* We'll keep an array of pointers to the allocated blocks here... */
+    if ((trace->blocks = 
+	 (char **)malloc(num_ids * sizeof(char *))) == NULL)
+	unix_error("malloc 3 failed in read_trace");
+
+    /* ... along with the corresponding byte sizes of each block */
+    if ((trace->block_sizes = 
+	 (size_t *)malloc(num_ids * sizeof(size_t))) == NULL)
+	unix_error("malloc 4 failed in read_trace");
+
+    return trace;
+}
+
+/*
+ * parse_int - skip blanks and parse a decimal integer at *pp, advancing
+ *     *pp past it. Returns 0 if there is no integer before end.
+ */
+static int parse_int(char **pp, char *end, long *val)
+{
+    char *p = *pp;
+    long v = 0;
+    int neg = 0;
+
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+	p++;
+    if (p < end && *p == '-') {
+	neg = 1;
+	p++;
+    }
+    if (p == end || *p < '0' || *p > '9')
+	return 0;
+    while (p < end && *p >= '0' && *p <= '9')
+	v = 10*v + (*p++ - '0');
+    *val = neg ? -v : v;
+    *pp = p;
+    return 1;
+}
+
+/*
+ * trace_error - report a malformed tracefile at path and exit. fmt 
+ *     contains one %s, which is replaced by path.
+ */
+static void trace_error(char *fmt, char *path)
+{
+    printf(fmt, path);
+    printf("\n");
+    exit(1);
+}
+
+/* 
+ * unix_error - Report a Unix-style error
+ */
+static void unix_error(char *msg) 
+{
+    printf("%s: %s\n", msg, strerror(errno));
+    exit(1);
+}
+
+/*
+ * get_varint - decode the LEB128 varint at *pp into *val, advancing *pp
+ *     past it. Returns 0 if it runs past end or doesn't fit 64 bits.
+ */
+static int get_varint(unsigned char **pp, unsigned char *end, 
+		      unsigned long long *val)
+{
+    unsigned char *p = *pp;
+    unsigned long long v = 0;
+    int shift = 0;
+
+    do {
+	if (p == end || shift > 63)
+	    return 0;
+	v |= (unsigned long long)(*p & 0x7f) << shift;
+	shift += 7;
+    } while (*p++ & 0x80);
+    *val = v;
+    *pp = p;
+    return 1;
+}
+
+/*
+ * put_varint - write val to fp as a LEB128 varint
+ */
+static void put_varint(FILE *fp, unsigned long long val)
+{
+    while (val >= 0x80) {
+	putc((int)(val & 0x7f) | 0x80, fp);
+	val >>= 7;
+    }
+    putc((int)val, fp);
+}
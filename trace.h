@@ -0,0 +1,61 @@
+/*
+ * trace.h - types and routines for reading malloc lab trace files
+ */
+#ifndef __TRACE_H_
+#define __TRACE_H_
+
+#include <stddef.h>
+
+/* Characterizes a single trace operation (allocator request) */
+typedef struct {
+    enum {ALLOC, FREE, REALLOC} type; /* type of request */
+    int index;                        /* index for free() to use later */
+    int size;                         /* byte size of alloc/realloc request */
+} traceop_t;
+
+/* Holds the information for one trace file*/
+typedef struct {
+    int sugg_heapsize;   /* suggested heap size (unused) */
+    int num_ids;         /* number of alloc/realloc ids */
+    int num_ops;         /* number of distinct requests */
+    int weight;          /* weight for this trace (unused) */
+    traceop_t *ops;      /* array of requests */
+    char **blocks;       /* array of ptrs returned by malloc/realloc... */
+    size_t *block_sizes; /* ... and a corresponding array of payload sizes */
+} trace_t;
+
+/*
+ * Binary trace format (files ending in TRACE_BIN_EXT). All multi-byte
+ * header fields are little endian.
+ *
+ *   bytes 0-3    TRACE_BIN_MAGIC
+ *   byte  4      TRACE_BIN_VERSION
+ *   bytes 5-7    reserved (0)
+ *   bytes 8-39   sugg_heapsize, num_ids, num_ops, weight (int64 each)
+ *
+ * followed by num_ops requests, each one type byte (ALLOC, FREE or
+ * REALLOC), the zigzag-encoded difference between its id and the
+ * previous request's id as a LEB128 varint, and, except for FREE, the
+ * size as a LEB128 varint.
+ */
+#define TRACE_BIN_EXT     ".rpb"
+#define TRACE_BIN_MAGIC   "MTRB"
+#define TRACE_BIN_VERSION 1
+#define TRACE_BIN_HDRSIZE 40
+
+/* Read the trace file tracedir/filename into memory */
+trace_t *read_trace(char *tracedir, char *filename);
+
+/* Same, but parse the file with stdio (slower; kept for comparison) */
+trace_t *read_trace_stdio(char *tracedir, char *filename);
+
+/* Free a trace returned by read_trace or read_trace_stdio */
+void free_trace(trace_t *trace);
+
+/* Write trace to path, in binary if path ends in TRACE_BIN_EXT */
+int write_trace(trace_t *trace, char *path);
+
+/* Does path name a binary trace file? */
+int is_binary_trace(char *path);
+
+#endif /* __TRACE_H_ */
@@ -0,0 +1,40 @@
+/*
+ * traceconv.c - convert trace files between the text (.rep) and binary
+ *     (.rpb) formats. The format of each file is chosen by its extension.
+ *
+ * Usage: traceconv <infile> <outfile>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "trace.h"
+
+int verbose = 0; /* read by trace.c */
+
+int main(int argc, char **argv)
+{
+    trace_t *trace;
+    struct stat in, out;
+
+    if (argc != 3) {
+	fprintf(stderr, "Usage: traceconv <infile> <outfile>\n");
+	fprintf(stderr, "Files ending in %s are binary traces, "
+		"all others are text.\n", TRACE_BIN_EXT);
+	exit(1);
+    }
+
+    trace = read_trace("", argv[1]);
+    if (write_trace(trace, argv[2]) < 0) {
+	printf("Could not write %s: %s\n", argv[2], strerror(errno));
+	exit(1);
+    }
+    if (stat(argv[1], &in) == 0 && stat(argv[2], &out) == 0)
+	printf("%s (%ld bytes) -> %s (%ld bytes), %d requests\n", 
+	       argv[1], (long)in.st_size, argv[2], (long)out.st_size, 
+	       trace->num_ops);
+    free_trace(trace);
+    exit(0);
+}
@@ -0,0 +1,516 @@
+/*
+ * tracegen.c - generate synthetic trace files from parameterised models
+ *
+ * Usage: tracegen [-s <seed>] -o <file> <phase> [-P <phase>]...
+ *
+ * A trace is a sequence of phases, each a number of requests drawn from
+ * its own model. Options describe the current phase; -P starts a new
+ * one, which begins as a copy of the last, so only what changes needs
+ * to be given again. Blocks outlive the phase that allocated them, so
+ * a change of model shows up the way it does in real programs. The
+ * models are:
+ *
+ *   -n <ops>       Number of requests in the phase (default 100000).
+ *   -z <dist>      Payload sizes in bytes:
+ *                      fixed,<n>
+ *                      uniform,<lo>,<hi>
+ *                      power,<alpha>,<lo>,<hi>     (truncated power law)
+ *                      bimodal,<small>,<large>,<p> (large with chance p)
+ *                      classes,<s1>,<s2>,...       (equally likely)
+ *   -L <dist>      Lifetimes, in requests until the block is freed:
+ *                      fixed,<n>
+ *                      uniform,<lo>,<hi>
+ *                      exp,<mean>
+ *                      power,<alpha>,<lo>,<hi>
+ *                      fifo,<batch>   (producer/consumer: allocate a
+ *                                      batch, then free it in order)
+ *                      forever        (freed only at the end)
+ *   -r <p>,<g>,<k> A fraction p of the blocks grow by a realloc chain:
+ *                  k reallocs spread over the block's lifetime, each
+ *                  making it g times larger.
+ *
+ * Every block still live at the end is freed, so the traces are
+ * balanced like the -bal traces; those frees come on top of the -n
+ * requests of the phases. The same seed always gives the same
+ * trace. The generator only holds the live blocks in memory, so traces
+ * of hundreds of millions of requests can be written; replay those
+ * with "mdriver -S", or convert them with traceconv first.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+
+#define MAXLINE    1024       /* max string size */
+#define MAXPHASES  64         /* max phases in a trace */
+#define MAXCLASSES 64         /* max classes in a "classes" distribution */
+#define MAXSIZE    (1<<30)    /* sizes are capped here */
+#define NEVER      ULLONG_MAX /* due time of blocks that live forever */
+#define HDRWIDTH   20         /* header fields are padded to this width */
+
+/* Kinds of distribution */
+enum {D_FIXED, D_UNIFORM, D_POWER, D_BIMODAL, D_CLASSES, D_EXP,
+      D_FIFO, D_FOREVER};
+
+/* A distribution and its parameters */
+typedef struct {
+    int kind;
+    double a, b, c;           /* parameters, in the order given */
+    int n;                    /* number of classes */
+    double v[MAXCLASSES];     /* the classes */
+} dist_t;
+
+/* One phase of the trace */
+typedef struct {
+    unsigned long long ops;   /* requests in this phase */
+    dist_t size;              /* payload sizes */
+    dist_t life;              /* lifetimes */
+    double realloc_p;         /* chance a block grows by reallocs... */
+    double growth;            /* ... by this factor each time... */
+    int chain;                /* ... this many times */
+} phase_t;
+
+/* A live block and the next request that will be made on it */
+typedef struct {
+    unsigned long long when;  /* request number it is due at */
+    unsigned long long step;  /* requests between its reallocs */
+    double growth;            /* what each realloc multiplies its size by */
+    int id;                   /* block id */
+    int size;                 /* its current size */
+    int left;                 /* reallocs still to come before the free */
+} block_t;
+
+/* The live blocks, in a binary heap ordered by when */
+static block_t *heap = NULL;
+static size_t nheap = 0, maxheap = 0;
+
+/* The current producer/consumer batch, in allocation order */
+static block_t *batch = NULL;
+static int nbatch = 0, maxbatch = 0, batch_head = 0;
+
+/* What has been written so far */
+static FILE *out;
+static unsigned long long now = 0;     /* requests written */
+static int num_ids = 0;                /* blocks allocated */
+static long long live = 0, peak = 0;   /* live payload bytes */
+
+/* The random number generator state (xorshift64*) */
+static unsigned long long rng;
+
+/* function prototypes */
+static void run_phase(phase_t *ph);
+static int do_request(block_t *b);
+static void push_block(block_t *b);
+static void pop_block(void);
+static void sift_down(size_t i);
+static void parse_dist(char *str, dist_t *d, int lifetime);
+static double draw(dist_t *d);
+static double uniform(void);
+static void usage(void);
+
+int main(int argc, char **argv)
+{
+    phase_t phases[MAXPHASES];
+    int nphases = 1, c, i;
+    unsigned long long seed = 1;
+    char *path = NULL;
+    char *p;
+
+    /* The first phase's defaults */
+    memset(phases, 0, sizeof(phases));
+    phases[0].ops = 100000;
+    parse_dist("power,1.5,8,4096", &phases[0].size, 0);
+    parse_dist("exp,1000", &phases[0].life, 1);
+    phases[0].growth = 1.5;
+    phases[0].chain = 4;
+
+    while ((c = getopt(argc, argv, "s:o:n:z:L:r:Ph")) != EOF) {
+	phase_t *ph = &phases[nphases-1];
+	switch (c) {
+	case 's':
+	    seed = strtoull(optarg, NULL, 0);
+	    break;
+	case 'o':
+	    path = optarg;
+	    break;
+	case 'n':
+	    ph->ops = strtoull(optarg, NULL, 0);
+	    break;
+	case 'z':
+	    parse_dist(optarg, &ph->size, 0);
+	    break;
+	case 'L':
+	    parse_dist(optarg, &ph->life, 1);
+	    break;
+	case 'r':
+	    ph->realloc_p = strtod(optarg, &p);
+	    if (*p == ',')
+		ph->growth = strtod(p+1, &p);
+	    if (*p == ',')
+		ph->chain = strtol(p+1, &p, 10);
+	    if (*p != '\0' || ph->realloc_p < 0 || ph->realloc_p > 1 ||
+		ph->growth < 1 || ph->chain < 1) {
+		fprintf(stderr, "tracegen: bad realloc chain %s\n", optarg);
+		exit(1);
+	    }
+	    break;
+	case 'P':
+	    if (nphases == MAXPHASES) {
+		fprintf(stderr, "tracegen: at most %d phases\n", MAXPHASES);
+		exit(1);
+	    }
+	    phases[nphases] = phases[nphases-1];
+	    nphases++;
+	    break;
+	default:
+	    usage();
+	    exit(c != 'h');
+	}
+    }
+    if (path == NULL || optind != argc) {
+	usage();
+	exit(1);
+    }
+
+    /* Seed the generator; splitmix64 spreads small seeds out */
+    seed += 0x9e3779b97f4a7c15ULL;
+    seed = (seed ^ (seed >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    seed = (seed ^ (seed >> 27)) * 0x94d049bb133111ebULL;
+    rng = (seed ^ (seed >> 31)) | 1;
+
+    /*
+     * The header comes first but depends on the whole trace, so write
+     * blanks of the right width now and fill them in at the end
+     */
+    if ((out = fopen(path, "w")) == NULL) {
+	fprintf(stderr, "tracegen: could not open %s: %s\n",
+		path, strerror(errno));
+	exit(1);
+    }
+    setvbuf(out, NULL, _IOFBF, 1<<20);
+    fprintf(out, "%*s\n%*s\n%*s\n%*s\n", HDRWIDTH, "", HDRWIDTH, "",
+	    HDRWIDTH, "", HDRWIDTH, "");
+
+    for (i = 0; i < nphases; i++)
+	run_phase(&phases[i]);
+
+    /* Free whatever is still live */
+    while (nheap > 0) {
+	heap[0].left = 0;
+	do_request(&heap[0]);
+	pop_block();
+    }
+
+    rewind(out);
+    fprintf(out, "%*lld\n%*d\n%*llu\n%*d\n", HDRWIDTH, peak, HDRWIDTH,
+	    num_ids, HDRWIDTH, now, HDRWIDTH, 1);
+    if (fclose(out) != 0) {
+	fprintf(stderr, "tracegen: could not write %s: %s\n",
+		path, strerror(errno));
+	exit(1);
+    }
+    printf("%s: %llu requests, %d blocks, peak %lld bytes live\n",
+	   path, now, num_ids, peak);
+    exit(0);
+}
+
+/*
+ * run_phase - write the requests of one phase. Each request is the
+ *     next one due on a live block if there is one, else the next free
+ *     of a consumed batch, else a new block.
+ */
+static void run_phase(phase_t *ph)
+{
+    unsigned long long end = now + ph->ops;
+    unsigned long long life;
+    int fifo = (ph->life.kind == D_FIFO);
+    int consuming = 0;
+    block_t b;
+
+    while (now < end) {
+	if (nheap > 0 && heap[0].when <= now) {
+	    if (do_request(&heap[0])) {
+		heap[0].when = now + heap[0].step;
+		sift_down(0);
+	    }
+	    else
+		pop_block();
+	    continue;
+	}
+	if (consuming) {
+	    do_request(&batch[batch_head++]);
+	    if (batch_head == nbatch)
+		consuming = nbatch = batch_head = 0;
+	    continue;
+	}
+
+	/* A new block */
+	b.id = num_ids++;
+	b.size = (int)draw(&ph->size);
+	b.left = 0;
+	b.growth = ph->growth;
+	fprintf(out, "a %d %d\n", b.id, b.size);
+	now++;
+	live += b.size;
+	if (live > peak)
+	    peak = live;
+
+	if (fifo) {
+	    if (nbatch == maxbatch) {
+		maxbatch = maxbatch ? 2*maxbatch : 1024;
+		batch = (block_t *)realloc(batch, maxbatch * sizeof(block_t));
+		if (batch == NULL) {
+		    fprintf(stderr, "tracegen: out of memory\n");
+		    exit(1);
+		}
+	    }
+	    batch[nbatch++] = b;
+	    if (nbatch == (int)ph->life.a)
+		consuming = 1;
+	    continue;
+	}
+	if (ph->life.kind == D_FOREVER)
+	    b.when = NEVER;
+	else {
+	    life = (unsigned long long)draw(&ph->life);
+	    if (uniform() < ph->realloc_p) {
+		b.left = ph->chain;
+		b.step = life / (ph->chain + 1) + 1;
+		b.when = now + b.step;
+	    }
+	    else
+		b.when = now + life;
+	}
+	push_block(&b);
+    }
+
+    /* Leave an unfinished batch to be freed, in order, from now on */
+    while (batch_head < nbatch) {
+	batch[batch_head].when = now + batch_head;
+	push_block(&batch[batch_head++]);
+    }
+    nbatch = batch_head = 0;
+}
+
+/*
+ * do_request - write the next request on block b: a realloc that grows
+ *     it if it has reallocs left, else its free. Returns whether the 
+ *     block is still live.
+ */
+static int do_request(block_t *b)
+{
+    double size;
+
+    now++;
+    if (b->left > 0) {
+	b->left--;
+	size = b->size * b->growth;
+	if (size < b->size + 1)
+	    size = b->size + 1;
+	if (size > MAXSIZE)
+	    size = MAXSIZE;
+	live += (int)size - b->size;
+	if (live > peak)
+	    peak = live;
+	b->size = (int)size;
+	fprintf(out, "r %d %d\n", b->id, b->size);
+	return 1;
+    }
+    live -= b->size;
+    fprintf(out, "f %d\n", b->id);
+    return 0;
+}
+
+/*
+ * push_block - add a block to the heap of live blocks
+ */
+static void push_block(block_t *b)
+{
+    size_t i, parent;
+
+    if (nheap == maxheap) {
+	maxheap = maxheap ? 2*maxheap : 1024;
+	if ((heap = (block_t *)realloc(heap, maxheap * sizeof(block_t)))
+	    == NULL) {
+	    fprintf(stderr, "tracegen: out of memory\n");
+	    exit(1);
+	}
+    }
+    for (i = nheap++; i > 0; i = parent) {
+	parent = (i - 1) / 2;
+	if (heap[parent].when <= b->when)
+	    break;
+	heap[i] = heap[parent];
+    }
+    heap[i] = *b;
+}
+
+/*
+ * pop_block - remove the earliest block from the heap
+ */
+static void pop_block(void)
+{
+    heap[0] = heap[--nheap];
+    sift_down(0);
+}
+
+/*
+ * sift_down - restore the heap order below heap[i] after it got later
+ */
+static void sift_down(size_t i)
+{
+    block_t b = heap[i];
+    size_t child;
+
+    while ((child = 2*i + 1) < nheap) {
+	if (child + 1 < nheap && heap[child+1].when < heap[child].when)
+	    child++;
+	if (b.when <= heap[child].when)
+	    break;
+	heap[i] = heap[child];
+	i = child;
+    }
+    heap[i] = b;
+}
+
+/*
+ * parse_dist - parse a distribution given as "kind,param,..." into *d.
+ *     Lifetime distributions accept exp, fifo and forever; size
+ *     distributions accept bimodal and classes.
+ */
+static void parse_dist(char *str, dist_t *d, int lifetime)
+{
+    char buf[MAXLINE], *kind, *tok;
+    double v[MAXCLASSES];
+    int n = 0, want;
+
+    strncpy(buf, str, MAXLINE-1);
+    buf[MAXLINE-1] = '\0';
+    kind = strtok(buf, ",");
+    while ((tok = strtok(NULL, ",")) != NULL && n < MAXCLASSES)
+	v[n++] = atof(tok);
+
+    memset(d, 0, sizeof(dist_t));
+    if (kind == NULL)
+	want = -1;
+    else if (!strcmp(kind, "fixed")) {
+	d->kind = D_FIXED;
+	want = 1;
+    }
+    else if (!strcmp(kind, "uniform")) {
+	d->kind = D_UNIFORM;
+	want = 2;
+    }
+    else if (!strcmp(kind, "power")) {
+	d->kind = D_POWER;
+	want = 3;
+    }
+    else if (!strcmp(kind, "bimodal") && !lifetime) {
+	d->kind = D_BIMODAL;
+	want = 3;
+    }
+    else if (!strcmp(kind, "classes") && !lifetime) {
+	d->kind = D_CLASSES;
+	want = n > 0 ? n : -1;
+    }
+    else if (!strcmp(kind, "exp") && lifetime) {
+	d->kind = D_EXP;
+	want = 1;
+    }
+    else if (!strcmp(kind, "fifo") && lifetime) {
+	d->kind = D_FIFO;
+	want = 1;
+    }
+    else if (!strcmp(kind, "forever") && lifetime) {
+	d->kind = D_FOREVER;
+	want = 0;
+    }
+    else
+	want = -1;
+
+    if (want != n || (n > 0 && v[0] <= 0) ||
+	(d->kind == D_UNIFORM && v[1] < v[0]) ||
+	(d->kind == D_POWER && (v[1] < 1 || v[2] < v[1])) ||
+	(d->kind == D_BIMODAL && (v[2] < 0 || v[2] > 1)) ||
+	(d->kind == D_FIFO && v[0] > INT_MAX)) {
+	fprintf(stderr, "tracegen: bad %s distribution %s\n",
+		lifetime ? "lifetime" : "size", str);
+	exit(1);
+    }
+    d->n = n;
+    memcpy(d->v, v, n * sizeof(double));
+    d->a = n > 0 ? v[0] : 0;
+    d->b = n > 1 ? v[1] : 0;
+    d->c = n > 2 ? v[2] : 0;
+}
+
+/*
+ * draw - returns a random value from a distribution, at least 1 and at
+ *     most MAXSIZE
+ */
+static double draw(dist_t *d)
+{
+    double x, u = uniform();
+
+    switch (d->kind) {
+    case D_FIXED:
+	x = d->a;
+	break;
+    case D_UNIFORM:
+	x = d->a + floor(u * (d->b - d->a + 1));
+	break;
+    case D_POWER: /* invert the CDF of a Pareto truncated to [b, c] */
+	x = d->b / pow(1 - u * (1 - pow(d->b / d->c, d->a)), 1 / d->a);
+	break;
+    case D_BIMODAL:
+	x = (u < d->c) ? d->b : d->a;
+	break;
+    case D_CLASSES:
+	x = d->v[(int)(u * d->n)];
+	break;
+    case D_EXP:
+	x = -d->a * log(1 - u);
+	break;
+    default:
+	x = 1;
+    }
+    if (x < 1)
+	x = 1;
+    return x > MAXSIZE ? MAXSIZE : floor(x);
+}
+
+/*
+ * uniform - returns a random number in [0, 1). The generator is our
+ *     own so that a seed gives the same trace with any libc.
+ */
+static double uniform(void)
+{
+    rng ^= rng >> 12;
+    rng ^= rng << 25;
+    rng ^= rng >> 27;
+    return ((rng * 0x2545f4914f6cdd1dULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: tracegen [-s <seed>] -o <file> <phase> "
+	    "[-P <phase>]...\n");
+    fprintf(stderr, "Phase options (each -P starts a copy of the last "
+	    "phase):\n");
+    fprintf(stderr, "\t-n <ops>      Requests in the phase.\n");
+    fprintf(stderr, "\t-z <dist>     Sizes: fixed,n uniform,lo,hi "
+	    "power,alpha,lo,hi\n");
+    fprintf(stderr, "\t              bimodal,small,large,p "
+	    "classes,s1,s2,...\n");
+    fprintf(stderr, "\t-L <dist>     Lifetimes in requests: fixed,n "
+	    "uniform,lo,hi exp,mean\n");
+    fprintf(stderr, "\t              power,alpha,lo,hi fifo,batch "
+	    "forever\n");
+    fprintf(stderr, "\t-r <p>,<g>,<k> Grow a fraction p of blocks by k "
+	    "reallocs of factor g.\n");
+    fprintf(stderr, "Defaults: -n 100000 -z power,1.5,8,4096 -L exp,1000 "
+	    "-r 0,1.5,4 -s 1\n");
+}
@@ -0,0 +1,348 @@
+/*
+ * tracestream.c - read trace files in fixed-size chunks of requests
+ *
+ * A stream owns two chunk buffers of STREAM_CHUNK requests. A reader
+ * thread parses the file into one buffer while the caller replays the
+ * other, so the memory used is fixed no matter how long the trace is,
+ * and parsing overlaps with replay. Ids and sizes are 64 bits wide.
+ * Both the text and the binary (TRACE_BIN_EXT) formats are supported.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "tracestream.h"
+
+#define MAXLINE  1024        /* max string size */
+#define INBUF    (1<<20)     /* bytes read from the file at a time */
+
+#define UNZIGZAG(u)  ((long long)((u) >> 1) ^ -(long long)((u) & 1))
+
+struct trace_stream {
+    /* input side, only touched by the reader thread after open */
+    int fd;                          /* the trace file */
+    char path[MAXLINE];              /* its name, for error messages */
+    int binary;                      /* is it in the binary format? */
+    unsigned char *buf;              /* bytes read from fd... */
+    size_t pos, len;                 /* ... and how far we got in them */
+    unsigned long long prev_index;   /* id of the last request (binary) */
+    unsigned long long num_ids;      /* header fields */
+    unsigned long long num_ops;
+    unsigned long long ops_read;     /* requests parsed so far */
+
+    /* the double buffer, shared with the consumer under lock */
+    streamop_t *chunk[2];            /* the two chunk buffers */
+    int count[2];                    /* requests in each */
+    int ready[2];                    /* is each one full and unconsumed? */
+    int current;                     /* buffer the consumer holds, or -1 */
+    int last;                        /* consumer has had the final chunk */
+    int stop;                        /* consumer has closed the stream */
+    pthread_t reader;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+/* function prototypes */
+static void *reader_thread(void *arg);
+static int fill_chunk(trace_stream_t *ts, streamop_t *ops);
+static int next_byte(trace_stream_t *ts);
+static int read_u64(trace_stream_t *ts, unsigned long long *val);
+static int read_varint(trace_stream_t *ts, unsigned long long *val);
+static void stream_error(trace_stream_t *ts, char *what);
+
+/*
+ * open_trace_stream - open a trace file, read its header and start the
+ *     reader thread
+ */
+trace_stream_t *open_trace_stream(char *tracedir, char *filename)
+{
+    trace_stream_t *ts;
+    unsigned long long hdr[4];
+    unsigned char magic[8];
+    int i, j, c;
+
+    if ((ts = (trace_stream_t *)calloc(1, sizeof(trace_stream_t))) == NULL ||
+	(ts->buf = (unsigned char *)malloc(INBUF)) == NULL ||
+	(ts->chunk[0] = malloc(STREAM_CHUNK * sizeof(streamop_t))) == NULL ||
+	(ts->chunk[1] = malloc(STREAM_CHUNK * sizeof(streamop_t))) == NULL) {
+	printf("malloc failed in open_trace_stream: %s\n", strerror(errno));
+	exit(1);
+    }
+    strcpy(ts->path, tracedir);
+    strcat(ts->path, filename);
+    if ((ts->fd = open(ts->path, O_RDONLY)) < 0) {
+	printf("Could not open %s in open_trace_stream: %s\n", 
+	       ts->path, strerror(errno));
+	exit(1);
+    }
+    ts->binary = is_binary_trace(ts->path);
+
+    /* Read the trace file header */
+    if (ts->binary) {
+	for (i = 0; i < 8; i++)
+	    if ((c = next_byte(ts)) < 0)
+		stream_error(ts, "Bad header");
+	    else
+		magic[i] = c;
+	if (memcmp(magic, TRACE_BIN_MAGIC, 4) || magic[4] != TRACE_BIN_VERSION)
+	    stream_error(ts, "Bad header");
+	for (i = 0; i < 4; i++) {
+	    hdr[i] = 0;
+	    for (j = 0; j < 8; j++) {
+		if ((c = next_byte(ts)) < 0)
+		    stream_error(ts, "Bad header");
+		hdr[i] |= (unsigned long long)c << (8*j);
+	    }
+	}
+    }
+    else {
+	for (i = 0; i < 4; i++)
+	    if (!read_u64(ts, &hdr[i]))
+		stream_error(ts, "Bad header");
+    }
+    ts->num_ids = hdr[1];
+    ts->num_ops = hdr[2];
+
+    /* Start reading ahead */
+    ts->current = -1;
+    pthread_mutex_init(&ts->lock, NULL);
+    pthread_cond_init(&ts->cond, NULL);
+    if (pthread_create(&ts->reader, NULL, reader_thread, ts) != 0) {
+	printf("Could not start the trace reader thread\n");
+	exit(1);
+    }
+    return ts;
+}
+
+/*
+ * trace_stream_next - hand the chunk the caller was replaying back to
+ *     the reader, and point *ops at the next one. Returns the number of
+ *     requests in it, which is 0 once the whole trace has been read.
+ */
+int trace_stream_next(trace_stream_t *ts, streamop_t **ops)
+{
+    int b;
+
+    /* the reader stops after a short chunk, so don't wait for another */
+    if (ts->last) {
+	*ops = NULL;
+	return 0;
+    }
+
+    pthread_mutex_lock(&ts->lock);
+    if (ts->current >= 0) {
+	ts->ready[ts->current] = 0;
+	pthread_cond_broadcast(&ts->cond);
+    }
+    b = (ts->current + 1) % 2;
+    while (!ts->ready[b])
+	pthread_cond_wait(&ts->cond, &ts->lock);
+    ts->current = b;
+    pthread_mutex_unlock(&ts->lock);
+
+    *ops = ts->chunk[b];
+    if (ts->count[b] < STREAM_CHUNK)
+	ts->last = 1;
+    return ts->count[b];
+}
+
+/*
+ * trace_stream_num_ids - returns the number of ids in the trace header
+ */
+unsigned long long trace_stream_num_ids(trace_stream_t *ts)
+{
+    return ts->num_ids;
+}
+
+/*
+ * trace_stream_num_ops - returns the number of requests in the header
+ */
+unsigned long long trace_stream_num_ops(trace_stream_t *ts)
+{
+    return ts->num_ops;
+}
+
+/*
+ * close_trace_stream - stop the reader thread and free the stream
+ */
+void close_trace_stream(trace_stream_t *ts)
+{
+    pthread_mutex_lock(&ts->lock);
+    ts->stop = 1;
+    pthread_cond_broadcast(&ts->cond);
+    pthread_mutex_unlock(&ts->lock);
+    pthread_join(ts->reader, NULL);
+
+    pthread_mutex_destroy(&ts->lock);
+    pthread_cond_destroy(&ts->cond);
+    close(ts->fd);
+    free(ts->chunk[0]);
+    free(ts->chunk[1]);
+    free(ts->buf);
+    free(ts);
+}
+
+/*
+ * The remaining routines are internal helper routines 
+ */
+
+/*
+ * reader_thread - fill the two chunk buffers in turn until the trace
+ *     runs out (marked by a short chunk) or the stream is closed
+ */
+static void *reader_thread(void *arg)
+{
+    trace_stream_t *ts = (trace_stream_t *)arg;
+    int b = 0, n;
+
+    do {
+	/* wait for the consumer to give buffer b back */
+	pthread_mutex_lock(&ts->lock);
+	while (ts->ready[b] && !ts->stop)
+	    pthread_cond_wait(&ts->cond, &ts->lock);
+	pthread_mutex_unlock(&ts->lock);
+	if (ts->stop)
+	    break;
+
+	n = fill_chunk(ts, ts->chunk[b]);
+
+	pthread_mutex_lock(&ts->lock);
+	ts->count[b] = n;
+	ts->ready[b] = 1;
+	pthread_cond_broadcast(&ts->cond);
+	pthread_mutex_unlock(&ts->lock);
+	b = (b + 1) % 2;
+    } while (n == STREAM_CHUNK);
+
+    return NULL;
+}
+
+/*
+ * fill_chunk - parse up to STREAM_CHUNK requests into ops and return how
+ *     many there were
+ */
+static int fill_chunk(trace_stream_t *ts, streamop_t *ops)
+{
+    unsigned long long delta;
+    int n, c;
+
+    for (n = 0; n < STREAM_CHUNK; n++) {
+	/* the request type: a byte, or the first character of a word */
+	if (ts->binary) {
+	    if ((c = next_byte(ts)) < 0)
+		break;
+	    if (c > REALLOC)
+		stream_error(ts, "Corrupt request");
+	    ops[n].type = c;
+	    if (!read_varint(ts, &delta))
+		stream_error(ts, "Truncated request");
+	    ts->prev_index += UNZIGZAG(delta);
+	    ops[n].index = ts->prev_index;
+	}
+	else {
+	    while ((c = next_byte(ts)) == ' ' || c == '\t' || c == '\n' || 
+		   c == '\r')
+		;
+	    if (c < 0)
+		break;
+	    switch (c) {
+	    case 'a': ops[n].type = ALLOC; break;
+	    case 'r': ops[n].type = REALLOC; break;
+	    case 'f': ops[n].type = FREE; break;
+	    default:
+		printf("Bogus type character (%c) in tracefile %s\n", 
+		       c, ts->path);
+		exit(1);
+	    }
+	    while ((c = next_byte(ts)) >= 0 && c != ' ' && c != '\t')
+		;
+	    if (!read_u64(ts, &ops[n].index))
+		stream_error(ts, "Bad request line");
+	}
+
+	/* the size of allocs and reallocs */
+	ops[n].size = 0;
+	if (ops[n].type != FREE && 
+	    !(ts->binary ? read_varint(ts, &ops[n].size) : 
+	      read_u64(ts, &ops[n].size)))
+	    stream_error(ts, "Bad request line");
+	if (ops[n].index >= ts->num_ids)
+	    stream_error(ts, "Request id out of range");
+    }
+
+    ts->ops_read += n;
+    if (n < STREAM_CHUNK && ts->ops_read != ts->num_ops)
+	stream_error(ts, "Request count doesn't match the header");
+    return n;
+}
+
+/*
+ * next_byte - returns the next byte of the trace file, or -1 at EOF
+ */
+static int next_byte(trace_stream_t *ts)
+{
+    ssize_t n;
+
+    if (ts->pos == ts->len) {
+	while ((n = read(ts->fd, ts->buf, INBUF)) < 0 && errno == EINTR)
+	    ;
+	if (n <= 0)
+	    return -1;
+	ts->pos = 0;
+	ts->len = n;
+    }
+    return ts->buf[ts->pos++];
+}
+
+/*
+ * read_u64 - skip blanks and read a decimal integer into *val. Returns 0
+ *     if there isn't one.
+ */
+static int read_u64(trace_stream_t *ts, unsigned long long *val)
+{
+    unsigned long long v = 0;
+    int c;
+
+    while ((c = next_byte(ts)) == ' ' || c == '\t' || c == '\n' || c == '\r')
+	;
+    if (c < '0' || c > '9')
+	return 0;
+    do {
+	v = 10*v + (c - '0');
+    } while ((c = next_byte(ts)) >= '0' && c <= '9');
+    *val = v;
+    return 1;
+}
+
+/*
+ * read_varint - read a LEB128 varint into *val. Returns 0 if the file
+ *     ends first or it doesn't fit 64 bits.
+ */
+static int read_varint(trace_stream_t *ts, unsigned long long *val)
+{
+    unsigned long long v = 0;
+    int shift = 0, c;
+
+    do {
+	if ((c = next_byte(ts)) < 0 || shift > 63)
+	    return 0;
+	v |= (unsigned long long)(c & 0x7f) << shift;
+	shift += 7;
+    } while (c & 0x80);
+    *val = v;
+    return 1;
+}
+
+/*
+ * stream_error - report a malformed trace and exit
+ */
+static void stream_error(trace_stream_t *ts, char *what)
+{
+    printf("%s in tracefile %s (after %llu requests)\n", 
+	   what, ts->path, ts->ops_read);
+    exit(1);
+}
@@ -0,0 +1,35 @@
+/*
+ * tracestream.h - read trace files in fixed-size chunks of requests,
+ *     for replaying traces that are too large to hold in memory
+ */
+#ifndef __TRACESTREAM_H_
+#define __TRACESTREAM_H_
+
+#include "trace.h"
+
+/* Number of requests in each chunk handed out by trace_stream_next */
+#define STREAM_CHUNK (1<<16)
+
+/* A single request with 64-bit id and size */
+typedef struct {
+    int type;                /* ALLOC, FREE or REALLOC */
+    unsigned long long index;/* id of the block */
+    unsigned long long size; /* byte size of alloc/realloc request */
+} streamop_t;
+
+typedef struct trace_stream trace_stream_t;
+
+/* Open tracedir/filename (text or binary) and start reading ahead */
+trace_stream_t *open_trace_stream(char *tracedir, char *filename);
+
+/* Point *ops at the next chunk of requests; returns its length, 0 at EOF */
+int trace_stream_next(trace_stream_t *ts, streamop_t **ops);
+
+/* Header fields of the trace */
+unsigned long long trace_stream_num_ids(trace_stream_t *ts);
+unsigned long long trace_stream_num_ops(trace_stream_t *ts);
+
+/* Stop reading and free the stream */
+void close_trace_stream(trace_stream_t *ts);
+
+#endif /* __TRACESTREAM_H_ */